@@ -0,0 +1,245 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	bench.cpp
+@brief 	benchmark source
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#include "test.h"
+#include "font.h"
+#include "char_index.h"
+#include "drawer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ck
+{
+namespace test
+{
+
+// 重复运行fn, 返回每次的最短耗时(纳秒)
+template<typename Fn>
+static double measure(int repeat,Fn&& fn)
+{
+    double best = 0;
+    for(int r=0; r<repeat; ++r)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        const auto t1 = std::chrono::steady_clock::now();
+        const double ns = std::chrono::duration<double,std::nano>(t1 - t0).count();
+        if(r == 0 || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+bool benchIndex()
+{
+    // ASCII/拉丁字母 + 随机的CJK字符, 与常见的游戏字体相近
+    std::mt19937 rng(404);
+    std::vector<char32_t> codes;
+    for(char32_t c=0x20; c<0x250; ++c)
+        codes.push_back(c);
+    while(codes.size() < 8000)
+        codes.push_back(0x4E00 + rng() % 0x5200);
+
+    CharIndex index;
+    index.build(codes);
+    std::unordered_map<char32_t,uint32_t> map;
+    for(uint32_t i=0; i<codes.size(); ++i)
+        map[codes[i]] = i;
+
+    // 查找的文本: 大部分命中, 少量不存在的字符
+    std::vector<char32_t> text(1 << 20);
+    for(auto& it : text)
+    {
+        const auto r = rng() % 100;
+        if(r < 60)
+            it = 0x20 + rng() % 0x5F;
+        else if(r < 97)
+            it = codes[rng() % codes.size()];
+        else
+            it = 0xAC00 + rng() % 0x2BA4;
+    }
+
+    // 两种索引的结果相同
+    for(auto c : text)
+    {
+        const auto r = map.find(c);
+        CK_CHECK(index.find(c) == (r == map.end() ? CharIndex::npos : r->second));
+    }
+
+    volatile uint32_t sink = 0;
+    const auto t_index = measure(5,[&]{
+        uint32_t s = 0;
+        for(auto c : text)
+            s += index.find(c);
+        sink = s;
+    });
+    const auto t_map = measure(5,[&]{
+        uint32_t s = 0;
+        for(auto c : text)
+        {
+            const auto r = map.find(c);
+            s += r == map.end() ? CharIndex::npos : r->second;
+        }
+        sink = s;
+    });
+    const double n = (double)text.size();
+    std::cout << "index: " << codes.size() << " chars, " << text.size() << " lookups" << std::endl
+              << "  CharIndex          " << t_index / n << " ns/lookup" << std::endl
+              << "  std::unordered_map " << t_map / n << " ns/lookup" << std::endl;
+    return true;
+}
+
+// 生成的32位色字体, 每个字符的内容不同(不会被合并), 有一定的可压缩性
+struct BenchAdapter : Font::Adapter
+{
+    BenchAdapter(uint32_t count,uint16_t size)
+    {
+        _header = {};
+        _header.flag = Font::FL_BIT32;
+        _header.lineHeight = size;
+        std::mt19937 rng(404);
+        for(uint32_t i=0; i<count; ++i)
+        {
+            Font::Char ch;
+            ch.code = 0x4E00 + i;
+            ch.width = ch.height = ch.xadvance = size;
+            ch.pos = (uint32_t)_data.size();
+            for(int y=0; y<size; ++y)
+            {
+                for(int x=0; x<size; ++x)
+                {
+                    const bool on = (rng() % 4) != 0 && (x + y + i) % 5 != 0;
+                    const uint8_t a = on ? 0xff : 0;
+                    _data.insert(_data.end(),{ a,uint8_t(on ? i : 0),uint8_t(on ? y * 8 : 0),uint8_t(on ? x * 8 : 0) });
+                }
+            }
+            _chrs.push_back(ch);
+        }
+        _header.count = count;
+    }
+};
+
+static std::vector<uint8_t> read_file(const std::string& filename)
+{
+    std::ifstream fi(filename,std::ios::binary);
+    return { std::istreambuf_iterator<char>(fi),{} };
+}
+
+bool benchBlocks()
+{
+    Font fnt;
+    CK_CHECK(fnt.load(BenchAdapter(4000,48)));
+    const auto filename = (std::filesystem::temp_directory_path() / "ckfont_bench_blocks.ckf").string();
+    const unsigned hw = std::max(1u,std::thread::hardware_concurrency());
+    std::cout << "blocks: " << fnt.chrs().size() << " chars, " << fnt.data().size() / 1024 << " KiB data, "
+              << hw << " hardware threads" << std::endl;
+
+    // 硬件线程较少时也至少用4个线程保存, 检查输出一致
+    const unsigned top = std::max(hw,4u);
+    std::vector<uint8_t> first;
+    double save1 = 0, load1 = 0;
+    bool ok = true;
+    for(unsigned n=1; ; n = std::min(n * 2,top))
+    {
+        Font::setThreads(n);
+        const auto t_save = measure(3,[&]{ ok = fnt.save(filename,Font::CP_BLOCK) && ok; });
+        const auto t_load = measure(3,[&]{ Font f; ok = f.open(filename) && ok; });
+        CK_CHECK(ok);
+        // 输出与线程数无关
+        const auto bytes = read_file(filename);
+        if(n == 1)
+        {
+            first = bytes;
+            save1 = t_save;
+            load1 = t_load;
+        }
+        CK_CHECK(bytes == first);
+        std::printf("  threads %2u  save %8.2f ms (x%.2f)  load %8.2f ms (x%.2f)\n",
+                    n,t_save / 1e6,save1 / t_save,t_load / 1e6,load1 / t_load);
+        if(n == top)
+            break;
+    }
+    Font::setThreads(0);
+    std::filesystem::remove(filename);
+    std::cout << "  file " << first.size() / 1024 << " KiB" << std::endl;
+    return true;
+}
+
+// 只计算位置, 不绘制
+struct NullDrawer : FontDrawer
+{
+    mutable int sink = 0;
+    void perchar(int x,int y,const Font::Char*,const Font::DataPtr&) const override
+    { sink += x + y; }
+};
+
+bool benchKerning()
+{
+    Font plain;
+    CK_CHECK(plain.load(BenchAdapter(2000,16)));
+    // 常见字体的字距调整表: 一部分字符对有调整
+    std::mt19937 rng(404);
+    Font::KerningList list;
+    for(int i=0; i<20000; ++i)
+        list.push_back({ char32_t(0x4E00 + rng() % 2000),char32_t(0x4E00 + rng() % 2000),int16_t(int(rng() % 9) - 4) });
+    Font kerned = plain;
+    kerned.setKernings(list);
+
+    std::vector<char32_t> codes(1 << 18);
+    for(auto& it : codes)
+        it = 0x4E00 + rng() % 2000;
+    Font::CharPtrList chrs_plain,chrs_kerned;
+    plain.cs(std::u32string_view(codes.data(),codes.size()),chrs_plain);
+    kerned.cs(std::u32string_view(codes.data(),codes.size()),chrs_kerned);
+
+    // 单行时两者的宽度只差字距调整的总和
+    int sum = 0;
+    for(size_t i=1; i<codes.size(); ++i)
+        sum += kerned.kerning(codes[i - 1],codes[i]);
+    NullDrawer d;
+    FontDrawer::Options opts;
+    d.setFont(&plain);
+    const auto box_plain = d.draw(chrs_plain,0,0,-1,-1,opts);
+    d.setFont(&kerned);
+    const auto box_kerned = d.draw(chrs_kerned,0,0,-1,-1,opts);
+    CK_CHECK(box_kerned.w == box_plain.w + sum);
+
+    auto run = [&](const Font& fnt,const Font::CharPtrList& chrs,bool draw) {
+        d.setFont(&fnt);
+        return measure(5,[&]{
+            if(draw)
+                d.draw(chrs,0,0,4096,-1,opts);
+            else
+                d.measure(chrs,4096,-1,opts);
+        });
+    };
+    const double n = (double)codes.size();
+    std::cout << "kerning: " << kerned.kernings().size() << " pairs, " << codes.size() << " chars, 4096 px lines" << std::endl;
+    std::printf("  measure  none %6.2f ns/char  kerning %6.2f ns/char\n",
+                run(plain,chrs_plain,false) / n,run(kerned,chrs_kerned,false) / n);
+    std::printf("  draw     none %6.2f ns/char  kerning %6.2f ns/char\n",
+                run(plain,chrs_plain,true) / n,run(kerned,chrs_kerned,true) / n);
+    return true;
+}
+
+}
+}
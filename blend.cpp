@@ -0,0 +1,236 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	blend.cpp
+@brief 	pixel blending kernels source
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#include "blend_kernel.h"
+#include "cpu.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CK_BLEND_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CK_BLEND_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace ck
+{
+
+// x/255四舍五入, x <= 65535
+static inline uint32_t div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+color blend(color bg, color fg, BlendMode mode)
+{
+    switch (mode) {
+    case BM_NORMAL:
+        return mix(bg,fg,false);
+    case BM_MULTIPLY:
+        return mix(bg,fg,true);
+    case BM_ADD:
+    {
+        const auto af = ca(fg);
+        auto fx = [af](uint32_t bv,uint32_t fv){
+            return (uint8_t)std::min(255u,bv + div255(fv * af));
+        };
+        return argb((uint8_t)std::min(255u,(uint32_t)ca(bg) + af),
+                    fx(cr(bg),cr(fg)),fx(cg(bg),cg(fg)),fx(cb(bg),cb(fg)));
+    }
+    case BM_PREMUL:
+    {
+        const auto inv = 255u - ca(fg);
+        auto fx = [inv](uint32_t bv,uint32_t fv){
+            return (uint8_t)std::min(255u,fv + div255(bv * inv));
+        };
+        return argb(fx(ca(bg),ca(fg)),fx(cr(bg),cr(fg)),fx(cg(bg),cg(fg)),fx(cb(bg),cb(fg)));
+    }
+    }
+    return bg;
+}
+
+#if defined(CK_BLEND_SSE2)
+// AVX2内核在blend_avx2.cpp中, 使用单独的编译选项
+size_t blend_avx2(color* dst,const color* src,size_t n,BlendMode mode);
+size_t premultiply_avx2(color* p,size_t n);
+size_t swap_rb_avx2(color* p,size_t n);
+size_t unpack_argb_avx2(const uint8_t* src,color* out,size_t n);
+#endif
+
+namespace
+{
+
+// 各指令集的向量操作, 见blend_kernel.h
+#if defined(CK_BLEND_SSE2)
+struct Sse2
+{
+    static constexpr size_t N = 4;
+    using I = __m128i;
+    using F = __m128;
+
+    static inline I load(const color* p) { return _mm_loadu_si128((const __m128i*)p); }
+    static inline void store(color* p,I v) { _mm_storeu_si128((__m128i*)p,v); }
+    static inline I set32(uint32_t v) { return _mm_set1_epi32((int)v); }
+    static inline I set16(uint16_t v) { return _mm_set1_epi16((short)v); }
+    static inline I and_(I a,I b) { return _mm_and_si128(a,b); }
+    static inline I or_(I a,I b) { return _mm_or_si128(a,b); }
+    static inline I andnot(I a,I b) { return _mm_andnot_si128(a,b); }
+    static inline I add32(I a,I b) { return _mm_add_epi32(a,b); }
+    template<int k> static inline I srl32(I a) { return _mm_srli_epi32(a,k); }
+    template<int k> static inline I sll32(I a) { return _mm_slli_epi32(a,k); }
+    static inline I nz32(I a) { return _mm_cmpgt_epi32(a,_mm_setzero_si128()); }
+    static inline bool all_eq32(I a,I b) { return _mm_movemask_epi8(_mm_cmpeq_epi32(a,b)) == 0xffff; }
+    static inline I lo16(I a) { return _mm_unpacklo_epi8(a,_mm_setzero_si128()); }
+    static inline I hi16(I a) { return _mm_unpackhi_epi8(a,_mm_setzero_si128()); }
+    static inline I pack16(I lo,I hi) { return _mm_packus_epi16(lo,hi); }
+    static inline I add16(I a,I b) { return _mm_add_epi16(a,b); }
+    static inline I mul16(I a,I b) { return _mm_mullo_epi16(a,b); }
+    template<int k> static inline I srl16(I a) { return _mm_srli_epi16(a,k); }
+    static inline I adds8(I a,I b) { return _mm_adds_epu8(a,b); }
+    static inline F tof(I a) { return _mm_cvtepi32_ps(a); }
+    static inline I toi(F a) { return _mm_cvttps_epi32(a); }
+    static inline F setf(float v) { return _mm_set1_ps(v); }
+    static inline F addf(F a,F b) { return _mm_add_ps(a,b); }
+    static inline F subf(F a,F b) { return _mm_sub_ps(a,b); }
+    static inline F mulf(F a,F b) { return _mm_mul_ps(a,b); }
+    static inline F divf(F a,F b) { return _mm_div_ps(a,b); }
+};
+#elif defined(CK_BLEND_NEON)
+struct Neon
+{
+    static constexpr size_t N = 4;
+    using I = uint32x4_t;
+    using F = float32x4_t;
+
+    static inline I load(const color* p) { return vld1q_u32(p); }
+    static inline void store(color* p,I v) { vst1q_u32(p,v); }
+    static inline I set32(uint32_t v) { return vdupq_n_u32(v); }
+    static inline I set16(uint16_t v) { return vreinterpretq_u32_u16(vdupq_n_u16(v)); }
+    static inline I and_(I a,I b) { return vandq_u32(a,b); }
+    static inline I or_(I a,I b) { return vorrq_u32(a,b); }
+    static inline I andnot(I a,I b) { return vbicq_u32(b,a); }
+    static inline I add32(I a,I b) { return vaddq_u32(a,b); }
+    template<int k> static inline I srl32(I a) { return vshrq_n_u32(a,k); }
+    template<int k> static inline I sll32(I a) { return vshlq_n_u32(a,k); }
+    static inline I nz32(I a) { return vtstq_u32(a,a); }
+    static inline bool all_eq32(I a,I b) { return vminvq_u32(vceqq_u32(a,b)) == 0xffffffff; }
+    static inline I lo16(I a) { return vreinterpretq_u32_u16(vmovl_u8(vget_low_u8(vreinterpretq_u8_u32(a)))); }
+    static inline I hi16(I a) { return vreinterpretq_u32_u16(vmovl_u8(vget_high_u8(vreinterpretq_u8_u32(a)))); }
+    static inline I pack16(I lo,I hi) {
+        return vreinterpretq_u32_u8(vcombine_u8(vqmovn_u16(vreinterpretq_u16_u32(lo)),vqmovn_u16(vreinterpretq_u16_u32(hi))));
+    }
+    static inline I add16(I a,I b) { return vreinterpretq_u32_u16(vaddq_u16(vreinterpretq_u16_u32(a),vreinterpretq_u16_u32(b))); }
+    static inline I mul16(I a,I b) { return vreinterpretq_u32_u16(vmulq_u16(vreinterpretq_u16_u32(a),vreinterpretq_u16_u32(b))); }
+    template<int k> static inline I srl16(I a) { return vreinterpretq_u32_u16(vshrq_n_u16(vreinterpretq_u16_u32(a),k)); }
+    static inline I adds8(I a,I b) { return vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(a),vreinterpretq_u8_u32(b))); }
+    static inline F tof(I a) { return vcvtq_f32_u32(a); }
+    static inline I toi(F a) { return vcvtq_u32_f32(a); }
+    static inline F setf(float v) { return vdupq_n_f32(v); }
+    static inline F addf(F a,F b) { return vaddq_f32(a,b); }
+    static inline F subf(F a,F b) { return vsubq_f32(a,b); }
+    static inline F mulf(F a,F b) { return vmulq_f32(a,b); }
+    static inline F divf(F a,F b) { return vdivq_f32(a,b); }
+};
+#endif
+
+}
+
+void blend(color *dst, const color *src, size_t n, BlendMode mode)
+{
+    size_t i = 0;
+    // 按运行时检测(或setSimd指定)的指令集选择内核
+    switch (simd()) {
+#if defined(CK_BLEND_SSE2)
+    case SIMD_AVX2: i = blend_avx2(dst,src,n,mode); break;
+    case SIMD_SSE2: i = Kernel<Sse2>::run(dst,src,n,mode); break;
+#elif defined(CK_BLEND_NEON)
+    case SIMD_NEON: i = Kernel<Neon>::run(dst,src,n,mode); break;
+#endif
+    default: break;
+    }
+    for(; i<n; ++i)
+        dst[i] = blend(dst[i],src[i],mode);
+}
+
+void premultiply(color *p, size_t n)
+{
+    size_t i = 0;
+    switch (simd()) {
+#if defined(CK_BLEND_SSE2)
+    case SIMD_AVX2: i = premultiply_avx2(p,n); break;
+    case SIMD_SSE2: i = Kernel<Sse2>::premultiply(p,n); break;
+#elif defined(CK_BLEND_NEON)
+    case SIMD_NEON: i = Kernel<Neon>::premultiply(p,n); break;
+#endif
+    default: break;
+    }
+    for(; i<n; ++i)
+        p[i] = premultiply(p[i]);
+}
+
+void swapRedBlue(color *p, size_t n)
+{
+    size_t i = 0;
+    switch (simd()) {
+#if defined(CK_BLEND_SSE2)
+    case SIMD_AVX2: i = swap_rb_avx2(p,n); break;
+    case SIMD_SSE2: i = Kernel<Sse2>::swap_rb(p,n); break;
+#elif defined(CK_BLEND_NEON)
+    case SIMD_NEON: i = Kernel<Neon>::swap_rb(p,n); break;
+#endif
+    default: break;
+    }
+    for(; i<n; ++i)
+    {
+        const auto c = p[i];
+        p[i] = (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+    }
+}
+
+void unpackArgb(const uint8_t *src, color *out, size_t n)
+{
+    size_t i = 0;
+    switch (simd()) {
+#if defined(CK_BLEND_SSE2)
+    case SIMD_AVX2: i = unpack_argb_avx2(src,out,n); break;
+    case SIMD_SSE2: i = Kernel<Sse2>::unpack_argb(src,out,n); break;
+#elif defined(CK_BLEND_NEON)
+    case SIMD_NEON: i = Kernel<Neon>::unpack_argb(src,out,n); break;
+#endif
+    default: break;
+    }
+    for(; i<n; ++i)
+    {
+        const auto p = src + i * 4;
+        out[i] = argb(p[0],p[1],p[2],p[3]);
+    }
+}
+
+bool blend(color *dst, size_t stride, const Font::DataPtr &d)
+{
+    if(dst == nullptr || !d.valid())
+        return false;
+    thread_local std::vector<color> buf;
+    const auto w = d.w(), h = d.h();
+    buf.resize((size_t)w * h);
+    if(!d.copyTo(buf.data(),w * sizeof(color),Font::PF_BGRA8_PREMUL))
+        return false;
+    for(int y=0; y<h; ++y)
+        blend(dst + y * stride,buf.data() + (size_t)y * w,w,BM_PREMUL);
+    return true;
+}
+
+}
@@ -0,0 +1,53 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	blend.h
+@brief 	pixel blending kernels header
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_BLEND_H
+#define CK_BLEND_H
+
+#include "font.h"
+
+namespace ck
+{
+
+// 混合方式, 颜色都是argb
+enum BlendMode {
+    BM_NORMAL,      // 普通混合(非预乘alpha), 与mix(bg,fg,false)相同
+    BM_MULTIPLY,    // 正片叠底(非预乘alpha), 与mix(bg,fg,true)相同
+    BM_ADD,         // 相加: 颜色 = 背景 + 前景*前景alpha, alpha = 背景alpha + 前景alpha; 超出255截断
+    BM_PREMUL       // 预乘alpha的覆盖: 结果 = 前景 + 背景*(255-前景alpha), alpha也按此计算
+};
+
+// 混合一个像素, 整数精确计算后四舍五入
+color blend(color bg,color fg,BlendMode mode);
+
+// dst[i] = blend(dst[i],src[i],mode), 结果与逐个像素混合完全相同
+// 每次处理多个像素(SSE2/NEON 4个, AVX2 8个; 受内存带宽限制, 没有AVX-512的16个), 指令集在运行时选择, 见cpu.h
+// BM_ADD/BM_PREMUL是整数运算, BM_NORMAL/BM_MULTIPLY用浮点除法; BM_MULTIPLY只有背景不透明时使用SIMD
+void blend(color* dst,const color* src,size_t n,BlendMode mode);
+
+// 行格式转换, 与批量混合一样按运行时选择的指令集处理, 结果与逐个像素转换完全相同
+// p[i] = premultiply(p[i])
+void premultiply(color* p,size_t n);
+// 交换红色和蓝色通道(BGRA和RGBA互相转换)
+void swapRedBlue(color* p,size_t n);
+// src是n个按a,r,g,b字节顺序存储的像素(FL_BIT32的字符数据), 转换为color写入out
+void unpackArgb(const uint8_t* src,color* out,size_t n);
+
+// 把字符d合成到dst, stride是dst每行的像素数; dst的颜色是预乘alpha的(不透明时与非预乘相同)
+// 字符颜色转换为预乘alpha后用BM_PREMUL混合, FL_PREMUL的字体不需要转换; 透明色(d.keyed())的像素不绘制
+bool blend(color* dst,size_t stride,const Font::DataPtr& d);
+
+}
+
+#endif // CK_BLEND_H
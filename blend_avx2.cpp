@@ -0,0 +1,114 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	blend_avx2.cpp
+@brief 	pixel blending kernels for AVX2
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+// 此文件单独使用AVX2编译选项(-mavx2 / /arch:AVX2), 只在cpu支持AVX2时由blend.cpp调用
+
+#include "blend_kernel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace ck
+{
+
+namespace
+{
+
+struct Avx2
+{
+    static constexpr size_t N = 8;
+    using I = __m256i;
+    using F = __m256;
+
+    static inline I load(const color* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    static inline void store(color* p,I v) { _mm256_storeu_si256((__m256i*)p,v); }
+    static inline I set32(uint32_t v) { return _mm256_set1_epi32((int)v); }
+    static inline I set16(uint16_t v) { return _mm256_set1_epi16((short)v); }
+    static inline I and_(I a,I b) { return _mm256_and_si256(a,b); }
+    static inline I or_(I a,I b) { return _mm256_or_si256(a,b); }
+    static inline I andnot(I a,I b) { return _mm256_andnot_si256(a,b); }
+    static inline I add32(I a,I b) { return _mm256_add_epi32(a,b); }
+    template<int k> static inline I srl32(I a) { return _mm256_srli_epi32(a,k); }
+    template<int k> static inline I sll32(I a) { return _mm256_slli_epi32(a,k); }
+    static inline I nz32(I a) { return _mm256_cmpgt_epi32(a,_mm256_setzero_si256()); }
+    static inline bool all_eq32(I a,I b) { return _mm256_movemask_epi8(_mm256_cmpeq_epi32(a,b)) == -1; }
+    static inline I lo16(I a) { return _mm256_unpacklo_epi8(a,_mm256_setzero_si256()); }
+    static inline I hi16(I a) { return _mm256_unpackhi_epi8(a,_mm256_setzero_si256()); }
+    static inline I pack16(I lo,I hi) { return _mm256_packus_epi16(lo,hi); }
+    static inline I add16(I a,I b) { return _mm256_add_epi16(a,b); }
+    static inline I mul16(I a,I b) { return _mm256_mullo_epi16(a,b); }
+    template<int k> static inline I srl16(I a) { return _mm256_srli_epi16(a,k); }
+    static inline I adds8(I a,I b) { return _mm256_adds_epu8(a,b); }
+    static inline F tof(I a) { return _mm256_cvtepi32_ps(a); }
+    static inline I toi(F a) { return _mm256_cvttps_epi32(a); }
+    static inline F setf(float v) { return _mm256_set1_ps(v); }
+    static inline F addf(F a,F b) { return _mm256_add_ps(a,b); }
+    static inline F subf(F a,F b) { return _mm256_sub_ps(a,b); }
+    static inline F mulf(F a,F b) { return _mm256_mul_ps(a,b); }
+    static inline F divf(F a,F b) { return _mm256_div_ps(a,b); }
+};
+
+}
+
+size_t blend_avx2(color* dst,const color* src,size_t n,BlendMode mode)
+{
+    return Kernel<Avx2>::run(dst,src,n,mode);
+}
+
+size_t premultiply_avx2(color* p,size_t n)
+{
+    return Kernel<Avx2>::premultiply(p,n);
+}
+
+size_t swap_rb_avx2(color* p,size_t n)
+{
+    return Kernel<Avx2>::swap_rb(p,n);
+}
+
+size_t unpack_argb_avx2(const uint8_t* src,color* out,size_t n)
+{
+    return Kernel<Avx2>::unpack_argb(src,out,n);
+}
+
+}
+
+#else
+
+namespace ck
+{
+
+// 没有使用AVX2编译选项时全部交给标量处理
+size_t blend_avx2(color*,const color*,size_t,BlendMode)
+{
+    return 0;
+}
+
+size_t premultiply_avx2(color*,size_t)
+{
+    return 0;
+}
+
+size_t swap_rb_avx2(color*,size_t)
+{
+    return 0;
+}
+
+size_t unpack_argb_avx2(const uint8_t*,color*,size_t)
+{
+    return 0;
+}
+
+}
+
+#endif
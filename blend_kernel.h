@@ -0,0 +1,216 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	blend_kernel.h
+@brief 	pixel blending kernel template (internal)
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_BLEND_KERNEL_H
+#define CK_BLEND_KERNEL_H
+
+#include "blend.h"
+
+// 内部头文件, 只被blend*.cpp包含
+// 每个指令集的源文件提供自己的向量操作V, 在各自的编译选项下实例化Kernel<V>
+// V需要放在匿名命名空间中, 避免不同编译选项的内联函数被链接器合并
+// V: N个像素的整数向量I(按需要视为32位/16位/8位通道), N个32位浮点F
+// 16位操作的lo16/hi16/pack16只要求互相对应, 像素的顺序不变
+
+namespace ck
+{
+
+// 以下内核的结果与标量的blend逐位相同:
+// BM_ADD/BM_PREMUL是整数运算, 16位通道的乘积不超过65025, div255对0~65535精确;
+// BM_NORMAL/BM_MULTIPLY要除以随像素变化的数, 用32位浮点除法: 运算中的整数都小于2^24, 可以精确表示,
+// 除法后+0.5截断的结果与整数的四舍五入相同, 由test_ckfont的blend_exhaustive穷举验证
+template<typename V>
+struct Kernel
+{
+    using I = typename V::I;
+    using F = typename V::F;
+
+    // 16位通道: x*y/255四舍五入
+    static inline I mul255(I x,I y)
+    {
+        const auto t = V::add16(V::mul16(x,y),V::set16(128));
+        return V::template srl16<8>(V::add16(t,V::template srl16<8>(t)));
+    }
+
+    // 每个像素的alpha复制到4个字节
+    static inline I alpha4(I p)
+    {
+        auto a = V::template srl32<24>(p);
+        a = V::or_(a,V::template sll32<8>(a));
+        return V::or_(a,V::template sll32<16>(a));
+    }
+
+    // 第k位开始的8位通道转为浮点
+    template<int k>
+    static inline F chan(I p)
+    {
+        if constexpr (k == 0)
+            return V::tof(V::and_(p,V::set32(0xff)));
+        else
+            return V::tof(V::and_(V::template srl32<k>(p),V::set32(0xff)));
+    }
+
+    // 四舍五入后转为整数, v >= 0
+    static inline I round(F v)
+    { return V::toi(V::addf(v,V::setf(0.5f))); }
+
+    static inline I argb(I a,I r,I g,I b)
+    {
+        return V::or_(V::or_(V::template sll32<24>(a),V::template sll32<16>(r)),
+                      V::or_(V::template sll32<8>(g),b));
+    }
+
+    static inline I add(I d,I s)
+    {
+        const auto a4 = alpha4(s);
+        auto t = V::pack16(mul255(V::lo16(s),V::lo16(a4)),mul255(V::hi16(s),V::hi16(a4)));
+        // alpha通道直接相加
+        const auto am = V::set32(0xff000000);
+        t = V::or_(V::andnot(am,t),V::and_(am,s));
+        return V::adds8(d,t);
+    }
+
+    static inline I premul(I d,I s)
+    {
+        const auto inv = V::andnot(alpha4(s),V::set32(0xffffffff));
+        const auto t = V::pack16(mul255(V::lo16(d),V::lo16(inv)),mul255(V::hi16(d),V::hi16(inv)));
+        return V::adds8(s,t);
+    }
+
+    // 颜色 = (bv*wb + fv*wf) / (wb + wf)
+    static inline I normal(I d,I s)
+    {
+        const auto ab = V::template srl32<24>(d);
+        const auto af = V::template srl32<24>(s);
+        const auto faf = V::tof(af);
+        const auto wb = V::mulf(V::tof(ab),V::subf(V::setf(255),faf));
+        const auto wf = V::mulf(V::setf(255),faf);
+        const auto x = V::addf(wb,wf);
+        auto fx = [&](F bv,F fv){
+            return round(V::divf(V::addf(V::mulf(bv,wb),V::mulf(fv,wf)),x));
+        };
+        const auto r = fx(chan<16>(d),chan<16>(s));
+        const auto g = fx(chan<8>(d),chan<8>(s));
+        const auto b = fx(chan<0>(d),chan<0>(s));
+        // alpha = x/255
+        auto a = V::add32(V::toi(x),V::set32(128));
+        a = V::template srl32<8>(V::add32(a,V::template srl32<8>(a)));
+        // 背景和前景都完全透明时为0
+        return V::and_(argb(a,r,g,b),V::nz32(V::or_(ab,af)));
+    }
+
+    // 背景不透明时: 颜色 = bv * (65025 - af*(255-fv)) / 65025
+    static inline I multiply(I d,I s)
+    {
+        const auto faf = V::tof(V::template srl32<24>(s));
+        auto fx = [&](F bv,F fv){
+            const auto t = V::subf(V::setf(65025),V::mulf(faf,V::subf(V::setf(255),fv)));
+            return round(V::divf(V::mulf(bv,t),V::setf(65025)));
+        };
+        const auto r = fx(chan<16>(d),chan<16>(s));
+        const auto g = fx(chan<8>(d),chan<8>(s));
+        const auto b = fx(chan<0>(d),chan<0>(s));
+        return argb(V::set32(0xff),r,g,b);
+    }
+
+    template<BlendMode M>
+    static size_t loop(color* dst,const color* src,size_t n)
+    {
+        size_t i = 0;
+        for(; i + V::N <= n; i += V::N)
+        {
+            const auto d = V::load(dst + i);
+            const auto s = V::load(src + i);
+            if constexpr (M == BM_NORMAL)
+                V::store(dst + i,normal(d,s));
+            else if constexpr (M == BM_ADD)
+                V::store(dst + i,add(d,s));
+            else if constexpr (M == BM_PREMUL)
+                V::store(dst + i,premul(d,s));
+            else if(V::all_eq32(V::template srl32<24>(d),V::set32(0xff)))
+                V::store(dst + i,multiply(d,s));
+            else
+            {
+                // 背景半透明时需要逐个像素做整数除法
+                for(size_t k=i; k<i+V::N; ++k)
+                    dst[k] = blend(dst[k],src[k],BM_MULTIPLY);
+            }
+        }
+        return i;
+    }
+
+    // 以下行转换同样返回已处理的像素数
+    // 预乘alpha, 与premultiply(color)相同: (2*v*a+255)/510就是v*a/255四舍五入
+    static size_t premultiply(color* p,size_t n)
+    {
+        const auto am = V::set32(0xff000000);
+        size_t i = 0;
+        for(; i + V::N <= n; i += V::N)
+        {
+            const auto s = V::load(p + i);
+            const auto a4 = alpha4(s);
+            const auto t = V::pack16(mul255(V::lo16(s),V::lo16(a4)),mul255(V::hi16(s),V::hi16(a4)));
+            V::store(p + i,V::or_(V::andnot(am,t),V::and_(am,s)));
+        }
+        return i;
+    }
+
+    // 交换红色和蓝色通道
+    static size_t swap_rb(color* p,size_t n)
+    {
+        const auto ag = V::set32(0xff00ff00);
+        const auto lo = V::set32(0xff);
+        size_t i = 0;
+        for(; i + V::N <= n; i += V::N)
+        {
+            const auto v = V::load(p + i);
+            const auto r = V::and_(V::template srl32<16>(v),lo);
+            const auto b = V::template sll32<16>(V::and_(v,lo));
+            V::store(p + i,V::or_(V::and_(v,ag),V::or_(r,b)));
+        }
+        return i;
+    }
+
+    // 按a,r,g,b字节顺序存储的像素转换为color, 即反转每个像素的字节序; src不要求对齐
+    static size_t unpack_argb(const uint8_t* src,color* out,size_t n)
+    {
+        const auto m1 = V::set32(0xff00);
+        const auto m2 = V::set32(0xff0000);
+        size_t i = 0;
+        for(; i + V::N <= n; i += V::N)
+        {
+            const auto v = V::load((const color*)(src + i * 4));
+            const auto x = V::or_(V::template srl32<24>(v),V::and_(V::template srl32<8>(v),m1));
+            const auto y = V::or_(V::and_(V::template sll32<8>(v),m2),V::template sll32<24>(v));
+            V::store(out + i,V::or_(x,y));
+        }
+        return i;
+    }
+
+    // 返回已处理的像素数, 剩余不足N个的像素由调用者处理
+    static size_t run(color* dst,const color* src,size_t n,BlendMode mode)
+    {
+        switch (mode) {
+        case BM_NORMAL: return loop<BM_NORMAL>(dst,src,n);
+        case BM_MULTIPLY: return loop<BM_MULTIPLY>(dst,src,n);
+        case BM_ADD: return loop<BM_ADD>(dst,src,n);
+        case BM_PREMUL: return loop<BM_PREMUL>(dst,src,n);
+        }
+        return 0;
+    }
+};
+
+}
+
+#endif // CK_BLEND_KERNEL_H
@@ -0,0 +1,201 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	char_index.cpp
+@brief 	character code index source
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#include "char_index.h"
+#include <algorithm>
+
+namespace ck
+{
+
+CharIndex::CharIndex()
+    : _ranges{{ 0,0x2FF }}
+{}
+
+void CharIndex::setDirect(const Ranges &ranges)
+{
+    _ranges = ranges;
+}
+
+const CharIndex::Ranges &CharIndex::direct() const
+{
+    return _ranges;
+}
+
+void CharIndex::build(const std::vector<char32_t> &codes)
+{
+    clear();
+    if(codes.empty())
+        return;
+
+    // 按实际存在的字符收缩每个码段
+    std::vector<bool> covered(codes.size(),false);
+    for(auto& r : _ranges)
+    {
+        char32_t lo = r.last, hi = r.first;
+        for(auto c : codes)
+        {
+            if(c >= r.first && c <= r.last)
+            {
+                lo = std::min(lo,c);
+                hi = std::max(hi,c);
+            }
+        }
+        if(lo > hi)
+            continue;
+        Table t{ lo,uint32_t(hi - lo + 1),(uint32_t)_direct.size() };
+        _direct.resize(_direct.size() + t.size,npos);
+        for(uint32_t i=0; i<(uint32_t)codes.size(); ++i)
+        {
+            // 码段重叠时已被前面的表覆盖的字符会跳过
+            const auto c = codes[i];
+            if(c < lo || c > hi || covered[i])
+                continue;
+            auto& idx = _direct[t.offset + c - lo];
+            if(idx == npos)
+                ++_size;
+            idx = i;
+            covered[i] = true;
+        }
+        _tables.push_back(t);
+    }
+
+    size_t rest = 0;
+    for(size_t i=0; i<codes.size(); ++i)
+    {
+        if(!covered[i])
+            ++rest;
+    }
+    if(rest == 0)
+        return;
+    rehash(rest);
+    for(uint32_t i=0; i<(uint32_t)codes.size(); ++i)
+    {
+        if(!covered[i] && insertSlot(codes[i],i))
+            ++_size;
+    }
+}
+
+void CharIndex::insert(char32_t code, uint32_t idx)
+{
+    if(auto p = directSlot(code))
+    {
+        if(*p == npos)
+            ++_size;
+        *p = idx;
+        return;
+    }
+    if((_used + 1) * 2 > _slots.size())
+        rehash(_used + 1);
+    if(insertSlot(code,idx))
+        ++_size;
+}
+
+void CharIndex::erase(char32_t code)
+{
+    if(auto p = directSlot(code))
+    {
+        if(*p != npos)
+            --_size;
+        *p = npos;
+        return;
+    }
+    if(_slots.empty())
+        return;
+    auto i = slot(code);
+    for(; ; i = (i + 1) & _mask)
+    {
+        const auto& it = _slots[i];
+        if(it.idx == npos)
+            return;
+        if(it.code == code)
+            break;
+    }
+    // 线性探测的删除: 把后面探测链上的元素向前移动, 不留墓碑
+    for(auto j = (i + 1) & _mask; _slots[j].idx != npos; j = (j + 1) & _mask)
+    {
+        const auto k = slot(_slots[j].code);
+        // k不在(i,j]之间说明该元素可以移到i
+        const bool movable = (i <= j) ? (k <= i || k > j) : (k <= i && k > j);
+        if(movable)
+        {
+            _slots[i] = _slots[j];
+            i = j;
+        }
+    }
+    _slots[i] = { 0,npos };
+    --_used;
+    --_size;
+}
+
+uint32_t *CharIndex::directSlot(char32_t code)
+{
+    for(auto& it : _tables)
+    {
+        const auto i = uint32_t(code - it.first);
+        if(i < it.size)
+            return &_direct[it.offset + i];
+    }
+    return nullptr;
+}
+
+void CharIndex::rehash(size_t count)
+{
+    uint32_t bits = 1;
+    while((1ull << bits) < count * 2ull)
+    {
+        ++bits;
+    }
+    auto old = std::move(_slots);
+    _slots.assign(size_t(1) << bits,Slot{ 0,npos });
+    _mask = (1u << bits) - 1;
+    _shift = 32 - bits;
+    _used = 0;
+    for(auto& it : old)
+    {
+        if(it.idx != npos)
+            insertSlot(it.code,it.idx);
+    }
+}
+
+bool CharIndex::insertSlot(char32_t code, uint32_t idx)
+{
+    for(auto k = slot(code); ; k = (k + 1) & _mask)
+    {
+        auto& it = _slots[k];
+        if(it.idx == npos)
+        {
+            it = { code,idx };
+            ++_used;
+            return true;
+        }
+        if(it.code == code)
+        {
+            it.idx = idx;
+            return false;
+        }
+    }
+}
+
+void CharIndex::clear()
+{
+    _tables.clear();
+    _direct.clear();
+    _slots.clear();
+    _mask = 0;
+    _shift = 32;
+    _used = 0;
+    _size = 0;
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	char_index.h
+@brief 	character code index header
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_CHAR_INDEX_H
+#define CK_CHAR_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ck
+{
+
+// 字符码 -> 字符列表下标 的索引, 可以一次构建, 也可以逐个插入/删除(均摊O(1)), 随字体的编辑更新
+// 常用码段(默认0~0x2FF)使用直接寻址表, 一次数组访问即可得到下标; 插入的字符码超出已建表的范围时放入哈希表
+// 其余字符码使用开放寻址的平坦哈希表, 槽位连续存放, 容量为2的幂且负载不超过1/2, 查找通常只访问一个缓存行
+class CharIndex
+{
+public:
+    static constexpr uint32_t npos = 0xFFFFFFFF;
+
+    // 码段[first,last]
+    struct Range
+    {
+        char32_t first;
+        char32_t last;
+    };
+    using Ranges = std::vector<Range>;
+
+    CharIndex();
+
+    // 设置直接寻址的码段, 在build之前设置; 只有字体中实际存在的字符范围才会建表
+    void setDirect(const Ranges& ranges);
+    const Ranges& direct() const;
+
+    // 构建索引, codes[i]对应下标i; 重复的字符码以最后一个为准
+    void build(const std::vector<char32_t>& codes);
+
+    // 从字符列表构建索引, T需要有code成员
+    template<typename T>
+    inline void build(const T* chrs,size_t size)
+    {
+        std::vector<char32_t> codes(size);
+        for(size_t i=0; i<size; ++i)
+        {
+            codes[i] = chrs[i].code;
+        }
+        build(codes);
+    }
+
+    // 插入或更新字符码对应的下标
+    void insert(char32_t code,uint32_t idx);
+    // 删除字符码
+    void erase(char32_t code);
+
+    // 查找字符码, 返回字符列表下标, 找不到返回npos
+    inline uint32_t find(char32_t code) const
+    {
+        for(auto& it : _tables)
+        {
+            const auto i = uint32_t(code - it.first);
+            if(i < it.size)
+                return _direct[it.offset + i];
+        }
+        if(_slots.empty())
+            return npos;
+        for(auto i = slot(code); ; i = (i + 1) & _mask)
+        {
+            const auto& it = _slots[i];
+            if(it.idx == npos || it.code == code)
+                return it.idx;
+        }
+    }
+
+    inline size_t size() const
+    { return _size; }
+
+    void clear();
+private:
+    struct Slot
+    {
+        char32_t code;
+        uint32_t idx;
+    };
+
+    // 直接寻址表, 覆盖[first,first+size)
+    struct Table
+    {
+        char32_t first;
+        uint32_t size;
+        uint32_t offset;    // 在_direct中的起始位置
+    };
+
+    // Fibonacci哈希, 连续的字符码也能均匀分布
+    inline uint32_t slot(char32_t code) const
+    { return (uint32_t(code) * 0x9E3779B1u) >> _shift; }
+
+    // 返回字符码在直接寻址表中的位置, 不在任何表的范围内返回nullptr
+    uint32_t* directSlot(char32_t code);
+    // 重新分配哈希表, 容量至少是count的2倍
+    void rehash(size_t count);
+    // 插入哈希表, 返回是否是新的字符码
+    bool insertSlot(char32_t code,uint32_t idx);
+
+    Ranges _ranges;
+    std::vector<Table> _tables;
+    std::vector<uint32_t> _direct;
+    std::vector<Slot> _slots;
+    uint32_t _mask = 0;
+    uint32_t _shift = 32;
+    size_t _used = 0;   // 哈希表中的字符数
+    size_t _size = 0;
+};
+
+}
+
+#endif // CK_CHAR_INDEX_H
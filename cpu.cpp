@@ -0,0 +1,135 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	cpu.cpp
+@brief 	runtime cpu feature dispatch source
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#include "cpu.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CK_CPU_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CK_CPU_NEON 1
+#endif
+
+static inline void warning(const char* text)
+{ std::cerr << "ck::Font [WARN] -> " << text << std::endl; }
+
+namespace ck
+{
+
+#if defined(CK_CPU_X86)
+static bool has_sse2()
+{
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    return true;    // 编译时已要求SSE2
+#else
+    return false;   // SSE2内核只在编译时启用SSE2的情况下编译
+#endif
+}
+
+static bool has_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info,0);
+    if(info[0] < 7)
+        return false;
+    __cpuid(info,1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if(!osxsave || !avx)
+        return false;
+    // 操作系统需要保存YMM寄存器
+    if((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info,7,0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+bool simdSupported(Simd simd)
+{
+    switch (simd) {
+    case SIMD_NONE:
+        return true;
+#if defined(CK_CPU_X86)
+    case SIMD_SSE2:
+        return has_sse2();
+    case SIMD_AVX2:
+    {
+        static const bool avx2 = has_sse2() && has_avx2();
+        return avx2;
+    }
+#elif defined(CK_CPU_NEON)
+    case SIMD_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+Simd simdDetect()
+{
+    for(auto it : { SIMD_AVX2,SIMD_SSE2,SIMD_NEON })
+    {
+        if(simdSupported(it))
+            return it;
+    }
+    return SIMD_NONE;
+}
+
+static std::atomic<int> g_simd{ -1 };
+
+Simd simd()
+{
+    auto v = g_simd.load(std::memory_order_relaxed);
+    if(v >= 0)
+        return (Simd)v;
+
+    Simd s = simdDetect();
+    if(const char* env = std::getenv("CKFONT_SIMD"))
+    {
+        const char* names[] = { "none","sse2","avx2","neon" };
+        int i = 0;
+        for(; i<4 && strcmp(env,names[i]) != 0; ++i);
+        if(i < 4 && simdSupported((Simd)i))
+            s = (Simd)i;
+        else
+            warning("CKFONT_SIMD is not supported, ignored!");
+    }
+    // 多个线程同时初始化时结果相同, 只保留第一个
+    int expected = -1;
+    g_simd.compare_exchange_strong(expected,s);
+    return (Simd)g_simd.load();
+}
+
+Simd setSimd(Simd simd)
+{
+    if(!simdSupported(simd))
+        simd = simdDetect();
+    g_simd = simd;
+    return simd;
+}
+
+}
@@ -0,0 +1,46 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	cpu.h
+@brief 	runtime cpu feature dispatch header
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_CPU_H
+#define CK_CPU_H
+
+namespace ck
+{
+
+// 像素内核使用的SIMD指令集
+// 分派的内核(blend.h): 批量混合blend(dst,src,n,mode), 行转换premultiply/swapRedBlue/unpackArgb;
+// DataPtr::copyTo和blend(dst,stride,d)通过它们使用SIMD, 其他格式(A1/A8/调色板/24位色)的解码和还原预乘是标量的
+enum Simd {
+    SIMD_NONE   = 0,    // 标量
+    SIMD_SSE2   = 1,
+    SIMD_AVX2   = 2,
+    SIMD_NEON   = 3
+};
+
+// 当前CPU(和编译出的内核)支持的最好的指令集
+Simd simdDetect();
+
+// 是否支持某指令集
+bool simdSupported(Simd simd);
+
+// 像素内核当前使用的指令集
+// 第一次调用时确定: 环境变量CKFONT_SIMD(none/sse2/avx2/neon)指定且支持时使用指定的, 否则使用simdDetect()
+Simd simd();
+
+// 指定像素内核使用的指令集(用于测试和基准对比), 不支持时使用simdDetect(); 返回实际使用的指令集
+Simd setSimd(Simd simd);
+
+}
+
+#endif // CK_CPU_H
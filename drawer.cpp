@@ -41,20 +41,27 @@ inline static void draw_line(
         return **(begin + (i % size));
     };
 
+    const auto fnt = drawer->font();
     int cx = x + line.ox;
     int cy = y + line.oy;
+    char32_t prev = 0;  // 前一个字符, 空白字符之后不做字距调整
     for(int i=line.left; i<line.right; ++i)
     {
         const auto& c = getchr(i);
-        const auto sp = whitespace(c) * wsp;
+        const auto ws = whitespace(c);
+        const auto sp = ws * wsp;
         if(sp != 0)
             cx += sp;
         else
         {
+            if(prev != 0 && ws == 0)
+                cx += fnt->kerning(prev,c.code);
             // cx += c.xoffset;
             drawer->perchar(cx + c.xoffset, cy + c.yoffset, &c, drawer->font()->getData(c));
             cx += c.xadvance + spacingX;
         }
+        // 按字符本身判断空白, 空格宽度为0时也与measure的kern一致
+        prev = ws == 0 ? c.code : 0;
     }
     if (out_box)
     {
@@ -101,6 +108,15 @@ FontDrawer::Box FontDrawer::measure(
         return **(begin + (i % size));
     };
 
+    // 与前一个字符的字距调整, 同draw_line: 行首和空白字符之后为0
+    auto kern = [this,&getchr](int i) -> int {
+        if(i <= 0) return 0;
+        const auto& a = getchr(i - 1);
+        const auto& b = getchr(i);
+        if(whitespace(a) || whitespace(b)) return 0;
+        return _font->kerning(a.code,b.code);
+    };
+
     // 计算文本宽高
     int textWidth = 0, textHeight = 0;
     {
@@ -115,7 +131,7 @@ FontDrawer::Box FontDrawer::measure(
                 line.left = i;
 
             const auto sp = whitespace(c) * wsp;
-            const auto cw = (sp == 0) ? c.xadvance : sp;  // 字符宽度
+            const auto cw = (sp == 0) ? c.xadvance + (i > line.left ? kern(i) : 0) : sp;  // 字符宽度, 包括与前一个字符的字距调整
             if((w >= 0 && lineWidth > 0 && lineWidth + cw > w) || c.code == '\n' || i == size)
             {
                 bool skip = c.code == '\n' || sp != 0;  // 是否跳过当前字符
@@ -131,7 +147,7 @@ FontDrawer::Box FontDrawer::measure(
                         const auto& it = getchr(j);
                         const auto sp = whitespace(it) * wsp;
                         if(sp == 0)
-                            lw -= c.xadvance + spc_x;
+                            lw -= c.xadvance + spc_x + (j > line.left ? kern(j) : 0);
                         else
                         {
                             lw -= sp;
@@ -169,8 +185,8 @@ FontDrawer::Box FontDrawer::measure(
                     continue;
                 }
             }
-            if(sp == 0)  // 空格忽略间隔
-                lineWidth += cw + spc_x;
+            if(sp == 0)  // 空格忽略间隔; 换行后当前字符在行首, 不做字距调整
+                lineWidth += c.xadvance + spc_x + (i > line.left ? kern(i) : 0);
             else
                 lineWidth += sp;
         }
@@ -130,6 +130,7 @@ struct FontDrawer
         );
 
     // @box 字符要绘制的位置和字符的宽高
+    // 绘制到argb缓冲区时可以用blend(dst,stride,d)合成(blend.h)
     virtual void perchar(int x, int y, const Font::Char* chr, const Font::DataPtr& d) const = 0;
 protected:
     const Font* _font = nullptr;
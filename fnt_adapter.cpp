@@ -15,6 +15,7 @@
 #include "fnt_adapter.h"
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -79,11 +80,44 @@ struct Page
 {
     stbi_uc* pixels;
     int w,h;    // 宽,高
-    bool bit32;  // 是否32位色
+    int channels;   // 原始图像的通道数
+    int format;     // 输出的颜色格式
+
+    // 像素的覆盖率
+    inline uint8_t coverage(const stbi_uc* p) const
+    {
+        if(channels == 2 || channels == 4)   // 带有alpha通道
+            return p[3];
+        return std::max(p[0],std::max(p[1],p[2]));
+    }
+
+    // 字符图像数据的大小
+    uint32_t size(const FntAdapter::FntChar& c) const
+    {
+        if(format == Font::FL_A1)
+            return (c.width + 7) / 8 * c.height;
+        return c.width * c.height * (format == Font::FL_BIT32 ? 4 : (format == Font::FL_A8 ? 1 : 3));
+    }
 
     void copy(const FntAdapter::FntChar& c,std::vector<uint8_t>& out) const
     {
-        const auto bit = bit32 ? 4 : 3;
+        if(format == Font::FL_A1)
+        {
+            const auto stride = (c.width + 7) / 8;
+            out.assign(stride * c.height,0);
+            for(int y=0; y<c.height; ++y)
+            {
+                for(int x=0; x<c.width; ++x)
+                {
+                    if(coverage(pixels + ((c.y + y) * w + c.x + x) * 4) >= 128)
+                        out[y * stride + x / 8] |= 0x80 >> (x % 8);
+                }
+            }
+            return;
+        }
+
+        const auto bit = format == Font::FL_BIT32 ? 4 : (format == Font::FL_A8 ? 1 : 3);
+        const auto src = format == 0 ? 3 : 4;  // 读取图像时的通道数
         const auto size = c.width * c.height * bit;
         out.resize(size);
         int i=0;
@@ -91,8 +125,12 @@ struct Page
         {
             for(int x=c.x; x<(c.x+c.width); ++x)
             {
-                const auto pos = (y * w + x) * bit;
-                if(bit32)
+                const auto pos = (y * w + x) * src;
+                if(format == Font::FL_A8)
+                {
+                    out[i] = coverage(pixels + pos);
+                }
+                else if(format == Font::FL_BIT32)
                 {
                     // argb
                     out[i] = pixels[pos+3];
@@ -114,11 +152,24 @@ struct Page
 
 bool FntAdapter::load(const std::string &filename, color transparent, bool bit32)
 {
+    return load(filename,bit32 ? Font::FL_BIT32 : Font::Flag(0),transparent);
+}
+
+bool FntAdapter::load(const std::string &filename, Font::Flag format, color transparent)
+{
+    format = Font::Flag(format & Font::FL_FORMAT);
+    if(format != 0 && format != Font::FL_BIT32 && format != Font::FL_A8 && format != Font::FL_A1)
+    {
+        std::cerr << "Font [WARN] -> Fnt adapter unsupported format! " << format << std::endl;
+        return false;
+    }
+
     std::ifstream fi(filename);
     if (!fi) return false;
 
     _chrs.clear();
     _data.clear();
+    _kernings.clear();
 
     struct
     {
@@ -175,6 +226,14 @@ bool FntAdapter::load(const std::string &filename, color transparent, bool bit32
             c.page = vint("page");
             chrs.push_back(c);
         }
+        else if (line.find("kerning ") == 0)
+        {
+            Font::Kerning k;
+            k.first = vint("first");
+            k.second = vint("second");
+            k.amount = (int16_t)std::clamp(vint("amount"),INT16_MIN,INT16_MAX);
+            _kernings.push_back(k);
+        }
     }
     fi.close();
 
@@ -182,7 +241,7 @@ bool FntAdapter::load(const std::string &filename, color transparent, bool bit32
     _header.count = info.count;
     _header.lineHeight = info.lineHeight;
     _header.transparent = transparent;
-    _header.flag = bit32 ? Font::FL_BIT32 : 0;
+    _header.flag = format;
     _header.padding[0] = info.padding[3];
     _header.padding[1] = info.padding[0];
     _header.padding[2] = info.padding[1];
@@ -191,12 +250,11 @@ bool FntAdapter::load(const std::string &filename, color transparent, bool bit32
     const auto path = filename.substr(0, filename.find_last_of("/\\") + 1);
     bool failed = false;
     std::vector<Page> pages;
-    int channels;
     for(auto& p : page_files)
     {
         Page page;
-        page.pixels = stbi_load((path + p).c_str(),&page.w,&page.h,&channels,bit32 ? STBI_rgb_alpha : STBI_rgb);
-        page.bit32 = bit32;
+        page.pixels = stbi_load((path + p).c_str(),&page.w,&page.h,&page.channels,format == 0 ? STBI_rgb : STBI_rgb_alpha);
+        page.format = format;
         if(page.pixels)
             pages.push_back(page);
         else
@@ -244,6 +302,12 @@ bool FntAdapter::load(const std::string &filename, color transparent, bool bit32
     }
 
     // 读取每个字符的图像数据
+    // 预先分配全部空间, 容量与大小一致, 移交给Font(load(Adapter&&))后不需要再整理
+    size_t total = 0;
+    for(auto& ch : chrs)
+        total += pages[ch.page].size(ch);
+    _data.reserve(_data.size() + total);
+    _chrs.reserve(_chrs.size() + chrs.size());
     uint32_t offset = 0;
     std::vector<uint8_t> buf;
     for(auto& ch : chrs)
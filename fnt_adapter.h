@@ -32,6 +32,9 @@ struct FntAdapter : public Font::Adapter
     // @bit32: 是否是32位颜色(带alpha通道), 为true时transparent无效,
     //         如果原始图像是24位色, 那么alpha值将始终为255
     bool load(const std::string &filename, color transparent, bool bit32 = false);
+    // @format: 颜色格式(Font::FL_BIT32/FL_A8/FL_A1, 0为24位色)
+    //          FL_A8/FL_A1的覆盖率取自图像的alpha通道, 图像没有alpha通道时取rgb的最大值; FL_A1以128为阈值
+    bool load(const std::string &filename, Font::Flag format, color transparent = 0);
 };
 
 }
@@ -13,12 +13,43 @@
 */
 
 #include "font.h"
+#include "utf.h"
+#include "glyph_view.h"
+#include "blend.h"
 #include <cstring>
+#include <algorithm>
 #include <map>
+#include <list>
+#include <unordered_map>
 #include <fstream>
+#include <atomic>
+#include <type_traits>
+#include <thread>
+#include <mutex>
 #include <iostream>
+#include <cstddef>
 #include <lz4xx.h>
 
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// 文件中的整数和颜色都是小端, 文件头/字符表/图像数据按字节直接读写和映射
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "ckfont only supports little-endian targets"
+#endif
+
 using namespace lz4xx;
 
 static inline void warning(const char* text)
@@ -31,34 +62,882 @@ using Header = Font::Header;
 using Char = Font::Char;
 using CharList = Font::CharList;
 using CharPtrList = Font::CharPtrList;
+using Kerning = Font::Kerning;
+using KerningList = Font::KerningList;
 
 static constexpr Char LT { '\t' };
 static constexpr Char L0 { '\0' };
 static constexpr Char LN { '\n' };
 
-// 计算data起始地址
-inline uint32_t address_start(const CharList& chrs)
-{ return sizeof(Header) + (uint32_t)chrs.size() * sizeof(Char); }
+color to_color_24(const uint8_t* p,uint32_t i,const color*)
+{ p += i; return rgb(*p,*(p+1),*(p+2)); }
+
+color to_color_32(const uint8_t* p,uint32_t i,const color*)
+{ p += i; return argb(*p,*(p+1),*(p+2),*(p+3)); }
+
+// 预乘alpha的32位色, 读取时还原
+color to_color_32p(const uint8_t* p,uint32_t i,const color*)
+{ p += i; return unpremultiply(argb(*p,*(p+1),*(p+2),*(p+3))); }
+
+color to_color_8(const uint8_t* p,uint32_t i,const color*)
+{ return argb(p[i],0xff,0xff,0xff); }
 
-color to_color_24(const uint8_t* p)
-{ return rgb(*p,*(p+1),*(p+2)); }
+color to_color_1(const uint8_t* p,uint32_t i,const color*)
+{ return (p[i >> 3] >> (7 - (i & 7))) & 1 ? 0xffffffff : 0x00ffffff; }
 
-color to_color_32(const uint8_t* p)
-{ return argb(*p,*(p+1),*(p+2),*(p+3)); }
+color to_color_p8(const uint8_t* p,uint32_t i,const color* palette)
+{ return palette[p[i]]; }
+
+color to_color_p4(const uint8_t* p,uint32_t i,const color* palette)
+{ return palette[(p[i >> 1] >> (i & 1 ? 0 : 4)) & 0xf]; }
 
 uint32_t offset_24(uint16_t x,uint16_t y, uint16_t w)
-{ return (y * w + x) * 3; }
+{ return ((uint32_t)y * w + x) * 3; }
 
 uint32_t offset_32(uint16_t x,uint16_t y, uint16_t w)
-{ return (y * w + x) * 4; }
+{ return ((uint32_t)y * w + x) * 4; }
+
+uint32_t offset_8(uint16_t x,uint16_t y, uint16_t w)
+{ return (uint32_t)y * w + x; }
+
+// 每行按字节对齐
+uint32_t offset_4(uint16_t x,uint16_t y, uint16_t w)
+{ return (uint32_t)y * ((w + 1u) & ~1u) + x; }
+
+// 每行按字节对齐
+uint32_t offset_1(uint16_t x,uint16_t y, uint16_t w)
+{ return (uint32_t)y * ((w + 7u) & ~7u) + x; }
+
+// 颜色格式, 多个格式标志时按优先级取一个, 0表示24位色
+inline int format(const Font::Header& h)
+{
+    for(int fl : { Font::FL_A1,Font::FL_A8,Font::FL_PAL4,Font::FL_PAL8,Font::FL_BIT32 })
+    {
+        if(h.flag & fl) return fl;
+    }
+    return 0;
+}
+
+// 32位色的图像数据是否预乘alpha
+inline bool premul(const Font::Header& h)
+{ return format(h) == Font::FL_BIT32 && (h.flag & Font::FL_PREMUL); }
+
+// 32位色图像数据的颜色预乘alpha或还原, 数据是argb字节序
+static void convert_premul(uint8_t* p,size_t size,bool on)
+{
+    for(size_t i=0; i + 4 <= size; i += 4,p += 4)
+    {
+        const color c = argb(p[0],p[1],p[2],p[3]);
+        const auto v = on ? premultiply(c) : unpremultiply(c);
+        p[1] = cr(v);
+        p[2] = cg(v);
+        p[3] = cb(v);
+    }
+}
 
-// 颜色位数
+// 每像素的位数
 inline int bit(const Font::Header& h)
-{ return h.flag & Font::FL_BIT32 ? 4 : 3; }
+{
+    switch (format(h)) {
+    case Font::FL_A1: return 1;
+    case Font::FL_PAL4: return 4;
+    case Font::FL_A8: case Font::FL_PAL8: return 8;
+    case Font::FL_BIT32: return 32;
+    default: return 24;
+    }
+}
+
+inline int bit(Font::fn_offset offset)
+{
+    if(offset == offset_1) return 1;
+    if(offset == offset_4) return 4;
+    if(offset == offset_8) return 8;
+    return offset == offset_32 ? 32 : 24;
+}
+
+// 调色板的颜色数, 非调色板格式为0
+inline uint32_t palette_size(const Font::Header& h)
+{
+    switch (format(h)) {
+    case Font::FL_PAL4: return 16;
+    case Font::FL_PAL8: return 256;
+    default: return 0;
+    }
+}
+
+// 某字符数据的大小, 每行按字节对齐
+inline uint32_t size_block(uint32_t w,uint32_t h,int bit)
+{ return (w * bit + 7) / 8 * h; }
 
-// 某字符数据的大小
 inline uint32_t size_block(const Char& ch,int bit)
-{ return ch.width * ch.height * bit; }
+{ return size_block(ch.width,ch.height,bit); }
+
+// 宽布局的字符最大65535x65535, 数据块大小可能超出uint32
+inline uint64_t size_block64(const Char& ch,int bit)
+{ return (uint64_t)size_block(ch.width,1,bit) * ch.height; }
+
+// 图像数据的大小, 即字符数据块的最大结束地址; 多个字符可以共用一个数据块
+inline uint64_t size_data(Font::CharSpan chrs,int bit)
+{
+    uint64_t size = 0;
+    for(auto& it : chrs)
+        size = std::max(size,(uint64_t)it.pos + size_block64(it,bit));
+    return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Layout
+// 文件标签后的一个字节: 低4位是压缩方式, 高4位是布局
+inline uint8_t compress_of(uint8_t mode) { return mode & 0xf; }
+inline uint8_t layout_of(uint8_t mode) { return mode >> 4; }
+
+// 紧凑布局的文件头和字符信息, 填充字节写明, 与旧版本编译器填充后的布局相同
+struct HeaderCompact
+{
+    uint8_t lang[4];
+    uint8_t flag;
+    uint8_t reserved0;
+    uint16_t count;
+    uint8_t lineHeight;
+    uint8_t maxWidth;
+    uint8_t spacingX;
+    uint8_t reserved1;
+    color transparent;
+    uint8_t padding[4];
+};
+
+struct CharCompact
+{
+    char32_t code;
+    uint32_t pos;
+    uint8_t width;
+    uint8_t height;
+    uint8_t xadvance;
+    int8_t xoffset;
+    int8_t yoffset;
+    uint8_t reserved[3];
+};
+
+// 文件布局不依赖编译器: 字段偏移固定, 没有隐式填充
+static_assert(sizeof(HeaderCompact) == 20 && offsetof(HeaderCompact,count) == 6 &&
+              offsetof(HeaderCompact,transparent) == 12,"unexpected HeaderCompact layout");
+static_assert(sizeof(CharCompact) == 16 && offsetof(CharCompact,width) == 8,"unexpected CharCompact layout");
+static_assert(sizeof(Header) == 24 && alignof(Header) == 4 &&
+              offsetof(Header,lineHeight) == 6 && offsetof(Header,count) == 8 &&
+              offsetof(Header,maxWidth) == 12 && offsetof(Header,transparent) == 16 &&
+              offsetof(Header,padding) == 20,"unexpected Header layout");
+static_assert(sizeof(Char) == 20 && alignof(Char) == 4 &&
+              offsetof(Char,pos) == 4 && offsetof(Char,width) == 8 && offsetof(Char,height) == 10 &&
+              offsetof(Char,xadvance) == 12 && offsetof(Char,xoffset) == 14 &&
+              offsetof(Char,yoffset) == 16,"unexpected Char layout");
+static_assert(std::is_trivially_copyable_v<Header> && std::is_trivially_copyable_v<Char>,
+              "Header/Char are copied as bytes");
+// 映射时字符表直接作为Char数组使用: 文件标签+文件头之后的地址必须满足Char的对齐
+static_assert((4 + sizeof(Header)) % alignof(Char) == 0,"char table is not aligned in the file");
+
+// 各布局的文件头和字符信息类型, 宽布局与内存相同
+template<int L> struct layout_t;
+template<> struct layout_t<Font::LO_COMPACT> { using header = HeaderCompact; using chr = CharCompact; };
+template<> struct layout_t<Font::LO_WIDE> { using header = Header; using chr = Char; };
+
+inline size_t size_header(int layout)
+{ return layout == Font::LO_WIDE ? sizeof(Header) : sizeof(HeaderCompact); }
+
+inline size_t size_char(int layout)
+{ return layout == Font::LO_WIDE ? sizeof(Char) : sizeof(CharCompact); }
+
+// 两种布局字段相同, 只是宽度不同
+template<typename To,typename From>
+inline void convert_header(const From& in,To& out)
+{
+    memcpy(out.lang,in.lang,4);
+    out.flag = in.flag;
+    out.count = (decltype(out.count))in.count;
+    out.lineHeight = (decltype(out.lineHeight))in.lineHeight;
+    out.maxWidth = (decltype(out.maxWidth))in.maxWidth;
+    out.spacingX = in.spacingX;
+    out.transparent = in.transparent;
+    memcpy(out.padding,in.padding,4);
+}
+
+template<typename To,typename From>
+inline void convert_char(const From& in,To& out)
+{
+    out.code = in.code;
+    out.pos = in.pos;
+    out.width = (decltype(out.width))in.width;
+    out.height = (decltype(out.height))in.height;
+    out.xadvance = (decltype(out.xadvance))in.xadvance;
+    out.xoffset = (decltype(out.xoffset))in.xoffset;
+    out.yoffset = (decltype(out.yoffset))in.yoffset;
+}
+
+// 从文件数据解码文件头
+static void decode_header(const uint8_t* p,int layout,Header& out)
+{
+    if(layout == Font::LO_WIDE)
+    {
+        memcpy(&out,p,sizeof(Header));
+        return;
+    }
+    HeaderCompact h;
+    memcpy(&h,p,sizeof(h));
+    memset(&out,0,sizeof(Header));
+    convert_header(h,out);
+}
+
+template<int L>
+static void decode_chars(const uint8_t* p,size_t n,Char* out)
+{
+    using C = typename layout_t<L>::chr;
+    if constexpr (std::is_same_v<C,Char>)
+        memcpy(out,p,n * sizeof(Char));
+    else
+    {
+        for(size_t i=0; i<n; ++i,p += sizeof(C))
+        {
+            C c;
+            memcpy(&c,p,sizeof(C));
+            convert_char(c,out[i]);
+        }
+    }
+}
+
+// 从文件数据解码n个字符信息, 每种布局只分派一次
+static void decode_chars(const uint8_t* p,size_t n,int layout,Char* out)
+{
+    if(layout == Font::LO_WIDE)
+        decode_chars<Font::LO_WIDE>(p,n,out);
+    else
+        decode_chars<Font::LO_COMPACT>(p,n,out);
+}
+
+// 读取count个元素, read(void* out,size_t size)返回是否读取成功
+// 内存随实际读到的数据按块增长, 文件中损坏的数量不会预先分配过大的内存
+template<typename T,typename Fn>
+static bool read_array(Fn&& read,size_t count,std::vector<T>& out)
+{
+    constexpr size_t chunk = ((size_t)1 << 20) / sizeof(T);
+    out.clear();
+    while(out.size() < count)
+    {
+        const auto start = out.size();
+        out.resize(start + std::min(chunk,count - start));
+        if(!read(out.data() + start,(out.size() - start) * sizeof(T)))
+            return false;
+    }
+    return true;
+}
+
+// 读取count个字符信息, 宽布局直接读入字符表, 紧凑布局读入后转换
+template<typename Fn>
+static bool read_chars(Fn&& read,int layout,size_t count,CharList& out)
+{
+    if(layout == Font::LO_WIDE)
+        return read_array(read,count,out);
+    std::vector<uint8_t> raw;
+    if(!read_array(read,count * size_char(layout),raw))
+        return false;
+    out.resize(count);
+    decode_chars(raw.data(),count,layout,out.data());
+    return true;
+}
+
+// 文件头和所有字符的尺寸/偏移是否都在紧凑布局的范围内
+static bool fits_compact(const Header& header,Font::CharSpan chrs)
+{
+    if(chrs.size() > UINT16_MAX || header.lineHeight > UINT8_MAX || header.maxWidth > UINT8_MAX)
+        return false;
+    auto fit = [](int v,int lo,int hi){ return v >= lo && v <= hi; };
+    for(auto& it : chrs)
+    {
+        if(it.width > UINT8_MAX || it.height > UINT8_MAX || it.xadvance > UINT8_MAX ||
+            !fit(it.xoffset,INT8_MIN,INT8_MAX) || !fit(it.yoffset,INT8_MIN,INT8_MAX))
+            return false;
+    }
+    return true;
+}
+
+// 按布局编码为文件数据, 追加到out; 紧凑布局的数值应已由fits_compact检查
+static void encode_table(const Header& header,Font::CharSpan chrs,int layout,std::vector<uint8_t>& out)
+{
+    const auto start = out.size();
+    out.resize(start + size_header(layout) + chrs.size() * size_char(layout),0);
+    auto p = out.data() + start;
+    if(layout == Font::LO_WIDE)
+    {
+        auto h = header;
+        h.reserved = 0;
+        memcpy(p,&h,sizeof(Header));
+        memcpy(p + sizeof(Header),chrs.data(),chrs.size() * sizeof(Char));
+        return;
+    }
+    HeaderCompact h = {};
+    convert_header(header,h);
+    memcpy(p,&h,sizeof(h));
+    p += sizeof(h);
+    for(auto& it : chrs)
+    {
+        CharCompact c = {};
+        convert_char(it,c);
+        memcpy(p,&c,sizeof(c));
+        p += sizeof(c);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Mapping
+// 只读的文件映射, 或者调用者持有的内存(不释放)
+struct Font::Mapping
+{
+    const uint8_t* ptr = nullptr;
+    size_t size = 0;
+
+    ~Mapping()
+    {
+        if(_borrowed)
+            return;
+#ifdef _WIN32
+        if(ptr) UnmapViewOfFile(ptr);
+        if(_map) CloseHandle(_map);
+        if(_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#else
+        if(ptr) munmap((void*)ptr,size);
+#endif
+    }
+
+    static std::shared_ptr<const Mapping> open(const std::string& filename)
+    {
+        std::shared_ptr<Mapping> m(new Mapping);
+#ifdef _WIN32
+        m->_file = CreateFileA(filename.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,
+                               OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+        if(m->_file == INVALID_HANDLE_VALUE)
+            return nullptr;
+        LARGE_INTEGER sz;
+        if(!GetFileSizeEx(m->_file,&sz) || sz.QuadPart == 0)
+            return nullptr;
+        m->_map = CreateFileMappingA(m->_file,nullptr,PAGE_READONLY,0,0,nullptr);
+        if(!m->_map)
+            return nullptr;
+        m->ptr = (const uint8_t*)MapViewOfFile(m->_map,FILE_MAP_READ,0,0,0);
+        if(!m->ptr)
+            return nullptr;
+        m->size = (size_t)sz.QuadPart;
+#else
+        const int fd = ::open(filename.c_str(),O_RDONLY);
+        if(fd < 0)
+            return nullptr;
+        struct stat st;
+        if(fstat(fd,&st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return nullptr;
+        }
+        void* p = mmap(nullptr,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+        ::close(fd);    // 映射建立后文件描述符不再需要
+        if(p == MAP_FAILED)
+            return nullptr;
+        m->ptr = (const uint8_t*)p;
+        m->size = (size_t)st.st_size;
+#endif
+        return m;
+    }
+
+    // 引用调用者的内存, 生命周期由调用者保证
+    static std::shared_ptr<const Mapping> borrow(const uint8_t* ptr,size_t size)
+    {
+        std::shared_ptr<Mapping> m(new Mapping);
+        m->ptr = ptr;
+        m->size = size;
+        m->_borrowed = true;
+        return m;
+    }
+
+private:
+    Mapping() = default;
+    bool _borrowed = false;
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _map = nullptr;
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Block
+// 分块压缩时每块的目标大小, 块总是在字符数据的边界上划分
+static constexpr uint32_t BLOCK_SIZE = 64 * 1024;
+
+// 分块压缩(CP_BLOCK)的数据块
+// 文件中只保存size和packed, pos和offset由前面的块累加得到
+struct block_t
+{
+    uint32_t pos = 0;       // 解压后在图像数据中的起始地址
+    uint32_t size = 0;      // 解压后的大小
+    uint32_t packed = 0;    // 压缩后的大小
+    uint64_t offset = 0;    // 压缩数据相对第一个块的偏移
+};
+using Blocks = std::vector<block_t>;
+
+// 按字符数据的边界划分压缩块, 要求数据是紧凑的
+static Blocks split_blocks(Font::CharSpan chrs,int bit)
+{
+    std::vector<std::pair<uint32_t,uint32_t>> ranges; // 字符数据的[pos,pos+size)
+    ranges.reserve(chrs.size());
+    for(auto& it : chrs)
+    {
+        ranges.emplace_back(it.pos,it.pos + size_block(it,bit));
+    }
+    std::sort(ranges.begin(),ranges.end());
+
+    Blocks blocks;
+    block_t b;
+    for(auto& it : ranges)
+    {
+        if(it.second <= b.pos + b.size)    // 与前面的数据重叠
+            continue;
+        if(b.size >= BLOCK_SIZE)
+        {
+            blocks.push_back(b);
+            b.pos += b.size;
+            b.size = 0;
+        }
+        b.size = it.second - b.pos;
+    }
+    if(b.size > 0)
+        blocks.push_back(b);
+    return blocks;
+}
+
+// 压缩/解压使用的线程数, 0表示使用硬件线程数
+static std::atomic<unsigned> g_threads{ 0 };
+
+// 在多个线程中执行fn(i), i∈[0,n); 每个i的结果只由i决定, 与线程数和执行顺序无关
+template<typename Fn>
+static void parallel_for(size_t n,Fn&& fn)
+{
+    size_t threads = g_threads.load();
+    if(threads == 0)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+    threads = std::min(threads,n);
+    if(threads <= 1)
+    {
+        for(size_t i=0; i<n; ++i)
+            fn(i);
+        return;
+    }
+    std::atomic<size_t> next{ 0 };
+    auto work = [&](){
+        for(size_t i; (i = next++) < n; )
+            fn(i);
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for(size_t i=1; i<threads; ++i)
+        pool.emplace_back(work);
+    work();
+    for(auto& it : pool)
+        it.join();
+}
+
+// 一个块压缩后大小的上限: LZ4_COMPRESSBOUND, 加上LZ4帧的帧头/块头/结束标记/校验
+inline uint64_t packed_bound(uint32_t size)
+{ return (uint64_t)size + size / 255 + 16 + ((uint64_t)size / BLOCK_SIZE + 1) * 8 + 32; }
+
+// 一个块解压后大小的上限: LZ4每个字节最多表示255个字节
+inline uint64_t unpacked_bound(uint32_t packed)
+{ return (uint64_t)packed * 255; }
+
+// 读取块索引, read(void* out,size_t size)返回是否读取成功
+// @avail 剩余的输入字节数, 未知时(流)为UINT64_MAX; 块数量或压缩数据超出输入时失败, 内存随实际读到的索引增长
+// 每块的大小和压缩后的大小必须符合LZ4的上下限, 图像数据总大小不超过uint32; 之后每块都满足pos+size<=size_blocks
+template<typename Fn>
+static bool read_blocks(Fn&& read,Blocks& out,uint64_t avail = UINT64_MAX)
+{
+    out.clear();
+    uint32_t count = 0;
+    if(!read(&count,4))
+        return false;
+    avail -= std::min<uint64_t>(avail,4);
+    if((uint64_t)count * 8 > avail)
+        return false;
+    avail -= (uint64_t)count * 8;
+    out.reserve(std::min<uint32_t>(count,4096));
+    uint64_t pos = 0;
+    uint64_t offset = 0;
+    for(uint32_t i=0; i<count; ++i)
+    {
+        block_t it;
+        if(!read(&it.size,4) || !read(&it.packed,4))
+            return false;
+        if(it.packed > packed_bound(it.size) || it.size > unpacked_bound(it.packed))
+            return false;
+        it.pos = (uint32_t)pos;
+        it.offset = offset;
+        pos += it.size;
+        offset += it.packed;
+        if(pos > UINT32_MAX || offset > avail)
+            return false;
+        out.push_back(it);
+    }
+    return true;
+}
+
+// 块索引中图像数据的总大小
+inline uint32_t size_blocks(const Blocks& blocks)
+{ return blocks.empty() ? 0 : blocks.back().pos + blocks.back().size; }
+
+// 压缩块中的压缩数据总大小
+inline uint64_t packed_blocks(const Blocks& blocks)
+{ return blocks.empty() ? 0 : blocks.back().offset + blocks.back().packed; }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Palette
+// 调色板格式在字符表之后保存调色板: uint32颜色数 + 颜色
+// 读取调色板, 内存中补齐到palette_size, 保证任意索引都不越界; 非调色板格式不读取
+// read(void* out,size_t size)返回是否读取成功
+template<typename Fn>
+static bool read_palette(Fn&& read,const Header& header,std::vector<color>& out,uint32_t& colors)
+{
+    const auto size = palette_size(header);
+    out.assign(size,0);
+    colors = 0;
+    if(size == 0)
+        return true;
+    if(!read(&colors,4) || colors > size)
+        return false;
+    return colors == 0 || read(out.data(),colors * sizeof(color));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Kerning
+// 文件头有FL_KERNING时在调色板之后保存字距调整表: uint32数量 + Kerning, 按(first,second)排序
+static_assert(sizeof(Kerning) == 12 && offsetof(Kerning,second) == 4 &&
+              offsetof(Kerning,amount) == 8,"unexpected Kerning layout");
+
+// 字距调整表的最大数量, 损坏的文件不会预先分配过大的内存
+static constexpr uint32_t KERNING_MAX = 1 << 22;
+
+// read(void* out,size_t size)返回是否读取成功
+template<typename Fn>
+static bool read_kernings(Fn&& read,const Header& header,KerningList& out)
+{
+    out.clear();
+    if(!(header.flag & Font::FL_KERNING))
+        return true;
+    uint32_t count = 0;
+    if(!read(&count,4) || count > KERNING_MAX)
+        return false;
+    return read_array(read,count,out);
+}
+
+// 字符码不超过21位, 低16位留给amount
+inline uint64_t kerning_key(char32_t first,char32_t second)
+{ return ((uint64_t)first << 21 | second) << 16; }
+
+inline size_t kerning_slot(uint64_t key,size_t mask)
+{ return (size_t)(((key >> 16) * 0x9E3779B97F4A7C15ull) >> 32) & mask; }
+
+inline bool kerning_less(const Kerning& a,const Kerning& b)
+{ return a.first < b.first || (a.first == b.first && a.second < b.second); }
+
+// 统计24/32位色图像数据中的颜色, 不超过256种时转换为调色板格式, 颜色按数值排序
+static bool palettize(const Header& header,const CharList& chrs,const std::vector<uint8_t>& data,
+                      Header& out_header,CharList& out_chrs,std::vector<uint8_t>& out_data,std::vector<color>& out_palette)
+{
+    const auto fmt = format(header);
+    if((fmt != 0 && fmt != Font::FL_BIT32) || chrs.empty() || premul(header))
+        return false;
+    const auto to_color = fmt == Font::FL_BIT32 ? to_color_32 : to_color_24;
+    const auto step = fmt == Font::FL_BIT32 ? 4u : 3u;
+
+    auto& palette = out_palette;
+    palette.clear();
+    color last = 0;
+    bool first = true;
+    for(auto& it : chrs)
+    {
+        const auto end = it.pos + size_block(it,bit(header));
+        for(auto i = it.pos; i < end; i += step)
+        {
+            const auto c = to_color(data.data(),i,nullptr);
+            if(!first && c == last)
+                continue;
+            first = false;
+            last = c;
+            const auto pos = std::lower_bound(palette.begin(),palette.end(),c);
+            if(pos != palette.end() && *pos == c)
+                continue;
+            if(palette.size() == 256)
+                return false;
+            palette.insert(pos,c);
+        }
+    }
+
+    out_header = header;
+    out_header.flag = (header.flag & ~Font::FL_FORMAT) | (palette.size() <= 16 ? Font::FL_PAL4 : Font::FL_PAL8);
+    // 32位色的透明度在调色板颜色的alpha中, 不使用透明色; 24位色保留透明色
+    if(fmt == 0)
+        out_header.flag |= Font::FL_KEYED;
+    else
+        out_header.flag &= ~Font::FL_KEYED;
+    const auto b = bit(out_header);
+    const auto offset = b == 4 ? offset_4 : offset_8;
+    out_chrs = chrs;
+    out_data.clear();
+    // 共用的数据块只转换一次: 原地址 -> 字符(转换后的地址和宽高)
+    std::unordered_map<uint32_t,Char> done;
+    for(auto& it : out_chrs)
+    {
+        const auto src = it.pos;
+        const auto r = done.find(src);
+        if(r != done.end() && r->second.width == it.width && r->second.height == it.height)
+        {
+            it.pos = r->second.pos;
+            continue;
+        }
+        it.pos = (uint32_t)out_data.size();
+        done[src] = it;
+        out_data.resize(out_data.size() + size_block(it,b),0);
+        const auto dst = out_data.data() + it.pos;
+        for(int y=0; y<it.height; ++y)
+        {
+            for(int x=0; x<it.width; ++x)
+            {
+                const auto c = to_color(data.data(),src + (y * it.width + x) * step,nullptr);
+                const auto idx = uint8_t(std::lower_bound(palette.begin(),palette.end(),c) - palette.begin());
+                const auto i = offset(x,y,it.width);
+                if(b == 4)
+                    dst[i >> 1] |= idx << (i & 1 ? 0 : 4);
+                else
+                    dst[i] = idx;
+            }
+        }
+    }
+    return true;
+}
+
+// 压缩一个数据块
+static bool compress_block(const uint8_t* data,uint32_t size,buffer_t& out)
+{
+    out.clear();
+    writer_buffer wtb(out);
+    auto ctx = lz4xx::compress(size,wtb);
+    if(!ctx.update(data,size))
+        return false;
+    ctx.finish();
+    return true;
+}
+
+// 把解压的数据直接写入固定大小的内存
+struct writer_memory : bio::iwriter
+{
+    inline writer_memory(uint8_t* ptr,size_t size)
+        : _ptr(ptr),_size(size)
+    {}
+
+    size_t write(const uint8_t* data,size_t size) override
+    {
+        const auto n = std::min(size,_size - _pos);
+        memcpy(_ptr + _pos,data,n);
+        _pos += n;
+        _overflow += size - n;
+        return size;
+    }
+
+    // 是否恰好写满
+    inline bool complete() const
+    { return _pos == _size && _overflow == 0; }
+private:
+    uint8_t* _ptr;
+    size_t _size;
+    size_t _pos = 0;
+    size_t _overflow = 0;
+};
+
+// 解压一个数据块到out, size必须是块解压后的大小
+static bool decompress_block(const uint8_t* packed,uint32_t packed_size,uint8_t* out,uint32_t size)
+{
+    auto rd = make_reader(packed,packed_size);
+    writer_memory wtm(out,size);
+    lz4xx::decompress(rd,wtm);
+    return wtm.complete();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pager
+// 按需读取字符图像数据, 最近使用的数据缓存在内存中, 超过容量时淘汰最久未使用的
+// 未压缩的数据按字符缓存, 分块压缩的数据按块解压和缓存
+// 可以在多线程中同时读取; 复制出的字体共用同一个Pager
+struct Font::Pager
+{
+    std::atomic<size_t> capacity;   // 缓存容量(字节)
+
+    // 从文件读取, offset是图像数据(或第一个压缩块)在文件中的起始位置
+    Pager(std::ifstream&& fi,uint64_t offset,size_t size,size_t capacity)
+        : capacity(capacity),_fi(std::move(fi)),_offset(offset),_size(size)
+    {}
+
+    // 从内存读取, holder保证内存在Pager销毁前有效
+    Pager(std::shared_ptr<const void> holder,const uint8_t* ptr,size_t size,size_t capacity)
+        : capacity(capacity),_holder(std::move(holder)),_ptr(ptr),_offset(0),_size(size)
+    {}
+
+    // 设置压缩块, 之后按块解压
+    void setBlocks(Blocks&& blocks)
+    {
+        _blocks = std::move(blocks);
+        _size = size_blocks(_blocks);
+    }
+
+    // 图像数据的总大小
+    inline size_t size() const
+    { return _size; }
+
+    // 读取[pos,pos+size)的数据, pin持有所属的缓存页, 返回的指针在pin释放之前有效(即使缓存页已被淘汰)
+    const uint8_t* fetch(uint32_t pos,uint32_t size,std::shared_ptr<const void>& pin)
+    {
+        if((size_t)pos + size > _size)
+            return nullptr;
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_blocks.empty())
+        {
+            auto page = cached(pos,size);
+            if(!page)
+            {
+                std::vector<uint8_t> data(size);
+                if(!read(pos,data.data(),size))
+                    return nullptr;
+                page = put(pos,std::move(data));
+            }
+            pin = page;
+            return page->data();
+        }
+
+        auto iter = std::upper_bound(_blocks.begin(),_blocks.end(),pos,[](uint32_t pos,const block_t& b){
+            return pos < b.pos;
+        });
+        const auto& b = *(iter - 1);
+        if(pos + size > b.pos + b.size) // 字符数据不会跨块
+            return nullptr;
+        auto page = cached(b.pos,b.size);
+        if(!page)
+        {
+            std::vector<uint8_t> data(b.size);
+            if(!unpack(b,data.data()))
+                return nullptr;
+            page = put(b.pos,std::move(data));
+        }
+        pin = page;
+        return page->data() + (pos - b.pos);
+    }
+
+    // 读取全部数据, 压缩块并行解压
+    bool readAll(std::vector<uint8_t>& out)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        out.resize(_size);
+        if(_blocks.empty())
+            return read(0,out.data(),_size);
+        auto packed = _ptr;
+        std::vector<uint8_t> buf;
+        if(!packed)
+        {
+            buf.resize(packed_blocks(_blocks));
+            if(!read(0,buf.data(),buf.size()))
+                return false;
+            packed = buf.data();
+        }
+        std::atomic<bool> ok{ true };
+        parallel_for(_blocks.size(),[&](size_t i){
+            const auto& b = _blocks[i];
+            if((uint64_t)b.pos + b.size > out.size() ||
+               !decompress_block(packed + b.offset,b.packed,out.data() + b.pos,b.size))
+                ok = false;
+        });
+        return ok;
+    }
+
+private:
+    // 缓存页; 淘汰时只移出缓存, 仍被DataPtr持有的页在最后一个持有者释放后销毁
+    using Page = std::shared_ptr<const std::vector<uint8_t>>;
+    struct Entry
+    {
+        uint32_t pos;
+        Page data;
+    };
+    using Lru = std::list<Entry>;
+    using Map = std::unordered_map<uint32_t,Lru::iterator>;
+
+    // 从源读取原始数据, offset相对图像数据的起始位置
+    bool read(uint64_t offset,uint8_t* out,size_t size)
+    {
+        if(_ptr)
+        {
+            memcpy(out,_ptr + offset,size);
+            return true;
+        }
+        _fi.clear();
+        _fi.seekg(std::streamoff(_offset + offset));
+        return (bool)_fi.read((char*)out,size);
+    }
+
+    // 解压一个块到out
+    bool unpack(const block_t& b,uint8_t* out)
+    {
+        if(_ptr)
+            return decompress_block(_ptr + b.offset,b.packed,out,b.size);
+        std::vector<uint8_t> packed(b.packed);
+        return read(b.offset,packed.data(),b.packed) &&
+               decompress_block(packed.data(),b.packed,out,b.size);
+    }
+
+    // 查找缓存, 命中时移到最前
+    Page cached(uint32_t pos,uint32_t size)
+    {
+        auto iter = _map.find(pos);
+        if(iter == _map.end())
+            return nullptr;
+        if(iter->second->data->size() < size)
+        {
+            drop(iter);
+            return nullptr;
+        }
+        _lru.splice(_lru.begin(),_lru,iter->second);
+        return iter->second->data;
+    }
+
+    // 加入缓存并淘汰, 至少保留刚加入的数据
+    Page put(uint32_t pos,std::vector<uint8_t>&& data)
+    {
+        _used += data.size();
+        _lru.push_front({ pos,std::make_shared<const std::vector<uint8_t>>(std::move(data)) });
+        _map[pos] = _lru.begin();
+        while(_used > capacity && _lru.size() > 1)
+        {
+            drop(_map.find(_lru.back().pos));
+        }
+        return _lru.front().data;
+    }
+
+    inline void drop(Map::iterator iter)
+    {
+        _used -= iter->second->data->size();
+        _lru.erase(iter->second);
+        _map.erase(iter);
+    }
+
+    std::ifstream _fi;
+    std::shared_ptr<const void> _holder;
+    const uint8_t* _ptr = nullptr;
+    uint64_t _offset;
+    size_t _size;
+    Blocks _blocks;
+    Lru _lru;
+    Map _map;
+    size_t _used = 0;
+    std::mutex _mutex;  // 保护文件读取和缓存
+};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Font
@@ -70,37 +949,60 @@ Font::Font()
 
 const Char &Font::c(char32_t c) const
 {
-    if (_chrs.empty() || c == '\r')
+    if (chrs().empty() || c == '\r')
         return L0;
     if (c == '\n')
         return LN;
     if (c == '\t')
         return LT;
-    auto iter = _map.find(c);
-    if(iter == _map.end())
+    const auto i = _index.find(c);
+    if(i == CharIndex::npos)
     {
         if(c == ' ')
             return _sp;
         else
-            return _chrs.front();
+            return chrs().front();
     }
-    return *iter->second;
+    return chrs()[i];
 }
 
+// 解码字符串并查找字符, char按UTF-8, wchar_t按UTF-16/UTF-32; 返回写入out的字符数
 template<typename C>
-inline Font::CharPtrList __cs(const Font &f,const C* str)
+inline size_t __cs(const Font &f,const C* str,size_t len,const Char** out,size_t capacity)
+{
+    size_t n = 0;
+    utf::decode(str,len,[&](char32_t ch){
+        if(n < capacity)
+            out[n++] = &f.c(ch);
+    });
+    return n;
+}
+
+template<typename C>
+inline size_t __cs(const Font &f,const C* str,size_t len,CharPtrList& out)
+{
+    out.resize(len);    // 码点数不会超过编码单元数
+    const auto n = __cs<C>(f,str,len,out.data(),len);
+    out.resize(n);
+    return n;
+}
+
+template<typename C>
+inline Font::CharPtrList __cs(const Font &f,const C* str,size_t len)
 {
     if (!str) return {};
-    const auto len = std::char_traits<C>::length(str);
     CharPtrList ret;
-    ret.resize(len);
-    for(int i=0;i<(int)len;++i)
-    {
-        ret[i] = &f.c(str[i]);
-    }
+    __cs<C>(f,str,len,ret);
     return ret;
 }
 
+template<typename C>
+inline Font::CharPtrList __cs(const Font &f,const C* str)
+{
+    if (!str) return {};
+    return __cs<C>(f,str,std::char_traits<C>::length(str));
+}
+
 Font::CharPtrList Font::cs(const char *str) const
 {
     return __cs<char>(*this,str);
@@ -118,17 +1020,47 @@ CharPtrList Font::cs(const char32_t *str) const
 
 Font::CharPtrList Font::css(const std::string &str) const
 {
-    return __cs<char>(*this,str.c_str());
+    return __cs<char>(*this,str.data(),str.size());
 }
 
 CharPtrList Font::css(const std::wstring &str) const
 {
-    return __cs<wchar_t>(*this,str.c_str());
+    return __cs<wchar_t>(*this,str.data(),str.size());
 }
 
 CharPtrList Font::css(const std::u32string &str) const
 {
-    return __cs<char32_t>(*this,str.c_str());
+    return __cs<char32_t>(*this,str.data(),str.size());
+}
+
+size_t Font::cs(std::string_view str, CharPtrList &out) const
+{
+    return __cs<char>(*this,str.data(),str.size(),out);
+}
+
+size_t Font::cs(std::wstring_view str, CharPtrList &out) const
+{
+    return __cs<wchar_t>(*this,str.data(),str.size(),out);
+}
+
+size_t Font::cs(std::u32string_view str, CharPtrList &out) const
+{
+    return __cs<char32_t>(*this,str.data(),str.size(),out);
+}
+
+size_t Font::cs(std::string_view str, const Char **out, size_t capacity) const
+{
+    return __cs<char>(*this,str.data(),str.size(),out,capacity);
+}
+
+size_t Font::cs(std::wstring_view str, const Char **out, size_t capacity) const
+{
+    return __cs<wchar_t>(*this,str.data(),str.size(),out,capacity);
+}
+
+size_t Font::cs(std::u32string_view str, const Char **out, size_t capacity) const
+{
+    return __cs<char32_t>(*this,str.data(),str.size(),out,capacity);
 }
 
 const Font::Header &Font::header() const
@@ -138,69 +1070,75 @@ const Font::Header &Font::header() const
 
 void Font::setHeader(const Header &header)
 {
-    int flag = 0;   // 不可更改的flag
-    if(_header.flag & FL_BIT32)
-        flag = FL_BIT32;
+    const int flag = _header.flag & (FL_FORMAT | FL_PREMUL | FL_KERNING | FL_KEYED);   // 不可更改的flag
     // padding 不能更改
     uint8_t padding[4]{0};
     memcpy(padding,_header.padding,4);
 
     _header = header;
-    _header.flag |= flag;
+    _header.flag = (_header.flag & ~(FL_FORMAT | FL_PREMUL | FL_KERNING | FL_KEYED)) | flag;
     _sp.width = std::max(_header.lineHeight / 2,2);
     _sp.height = _header.lineHeight;
 
     memcpy(_header.padding,padding,4);
 }
 
-const std::vector<uint8_t> &Font::data() const
+Span<uint8_t> Font::data() const
 {
+    if(_mapping)
+        return _vdata;
     return _data;
 }
 
+Span<color> Font::palette() const
+{
+    return _palette;
+}
+
 color Font::getColor(const Char &ch, int x, int y) const
 {
-    if(_header.flag & FL_BIT32)
-    {
-        const auto i = ch.pos + (y * ch.width + x) * 4;
-        return argb(_data[i],_data[i+1],_data[i+2],_data[i+3]);
-    }
-    else
-    {
-        const auto i = ch.pos + (y * ch.width + x) * 3;
-        return rgb(_data[i],_data[i+1],_data[i+2]);
-    }
+    std::shared_ptr<const void> pin;
+    const auto dat = block(ch,pin);
+    if(!dat) return 0;
+    return to_color(dat,offset(x,y,ch.width),_palette.data());
 }
 
 void Font::getColor(const Char &ch, int x, int y, uint8_t &out_r, uint8_t &out_g, uint8_t &out_b,uint8_t* out_a) const
 {
-    if(_header.flag & FL_BIT32)
-    {
-        const auto i = ch.pos + (y * ch.width + x) * 4;
-        out_r = _data[i+1];
-        out_g = _data[i+2];
-        out_b = _data[i+3];
-        if(out_a) *out_a = _data[i];
-    }
-    else
-    {
-        const auto i = ch.pos + (y * ch.width + x) * 3;
-        out_r = _data[i];
-        out_g = _data[i+1];
-        out_b = _data[i+2];
-        if(out_a) *out_a = 0xff;
-    }
+    const auto c = getColor(ch,x,y);
+    out_r = cr(c);
+    out_g = cg(c);
+    out_b = cb(c);
+    if(out_a) *out_a = ca(c);
 }
 
 Font::DataPtr Font::getData(const Char &ch) const
 {
-    auto iter = _map.find(ch.code);
-    if(iter == _map.end())
+    if(_index.find(ch.code) == CharIndex::npos)
         return { };
-    const auto upper = ch.pos + ch.width * ch.height * bit(_header);
-    if(upper > _data.size())
+    std::shared_ptr<const void> pin;
+    const auto ptr = block(ch,pin);
+    if(!ptr)
         return { };
-    return { this, _data.data() + ch.pos, ch.width, ch.height };
+    return { this, ptr, ch.width, ch.height, std::move(pin) };
+}
+
+const uint8_t *Font::block(const Char &ch,std::shared_ptr<const void>& pin) const
+{
+    const auto size = size_block(ch,bit(_header));
+    if(_pager)
+        return _pager->fetch(ch.pos,size,pin);
+    const auto dat = data();
+    if((size_t)ch.pos + size > dat.size())
+        return nullptr;
+    return dat.data() + ch.pos;
+}
+
+void Font::setCacheSize(size_t bytes)
+{
+    _cacheSize = bytes;
+    if(_pager)
+        _pager->capacity = bytes;
 }
 
 bool Font::getData(const Char &ch, Data &out) const
@@ -213,8 +1151,112 @@ bool Font::getData(const Char &ch, Data &out) const
     return true;
 }
 
-const Font::CharList &Font::chrs() const
+bool Font::premultiplied() const
+{
+    return premul(_header);
+}
+
+bool Font::setPremultiplied(bool on)
+{
+    if(format(_header) != FL_BIT32)
+        return false;
+    if(premul(_header) == on)
+        return true;
+    detach();
+    convert_premul(_data.data(),_data.size(),on);
+    if(on)
+        _header.flag |= FL_PREMUL;
+    else
+        _header.flag &= ~FL_PREMUL;
+    prepare();
+    return true;
+}
+
+void Font::setDirectRanges(const CharIndex::Ranges &ranges)
+{
+    _index.setDirect(ranges);
+    const auto chs = chrs();
+    _index.build(chs.data(),chs.size());
+}
+
+const CharIndex::Ranges &Font::directRanges() const
+{
+    return _index.direct();
+}
+
+Span<Font::Kerning> Font::kernings() const
+{
+    return _kernings;
+}
+
+void Font::setKernings(KerningList list)
+{
+    _kernings = std::move(list);
+    index_kernings();
+}
+
+int Font::kerning(char32_t first, char32_t second) const
+{
+    if(_kerningHash.empty() || (first | second) > 0x10FFFF)
+        return 0;
+    const auto key = kerning_key(first,second);
+    const auto mask = _kerningHash.size() - 1;
+    for(auto i = kerning_slot(key,mask);; i = (i + 1) & mask)
+    {
+        const auto v = _kerningHash[i];
+        if(v == 0)
+            return 0;
+        if((v & ~0xffffull) == key)
+            return (int16_t)(v & 0xffff);
+    }
+}
+
+void Font::index_kernings()
+{
+    auto& list = _kernings;
+    // 去掉无效的字符对, 排序; 同一字符对保留最后一个
+    list.erase(std::remove_if(list.begin(),list.end(),[](const Kerning& k){
+                   return k.amount == 0 || k.first > 0x10FFFF || k.second > 0x10FFFF;
+               }),list.end());
+    if(!std::is_sorted(list.begin(),list.end(),kerning_less))
+        std::stable_sort(list.begin(),list.end(),kerning_less);
+    size_t n = 0;
+    for(auto& it : list)
+    {
+        if(n > 0 && !kerning_less(list[n - 1],it))
+            list[n - 1] = it;
+        else
+            list[n++] = it;
+        list[n - 1].reserved = 0;
+    }
+    list.resize(n);
+
+    _kerningHash.clear();
+    if(list.empty())
+    {
+        _header.flag &= ~FL_KERNING;
+        return;
+    }
+    _header.flag |= FL_KERNING;
+    // 负载不超过一半, 查找时探测很短
+    size_t size = 16;
+    while(size < list.size() * 2)
+        size <<= 1;
+    _kerningHash.assign(size,0);
+    for(auto& it : list)
+    {
+        const auto key = kerning_key(it.first,it.second);
+        auto i = kerning_slot(key,size - 1);
+        while(_kerningHash[i] != 0)
+            i = (i + 1) & (size - 1);
+        _kerningHash[i] = key | (uint16_t)it.amount;
+    }
+}
+
+Font::CharSpan Font::chrs() const
 {
+    if(_mapping && _chrs.empty())   // 紧凑布局的字符表解码在_chrs中
+        return _vchrs;
     return _chrs;
 }
 
@@ -225,62 +1267,491 @@ bool Font::insert(const Char &ch, const Data &data)
         warning("invalid character size!");
         return false;
     }
-    auto& ref = data._data;
+    const std::vector<uint8_t>* src = &data._data;
+    std::vector<uint8_t> conv;
+    if(data.valid() && (data.offset != offset || data.to_color != to_color ||
+                        (palette_size(_header) > 0 && data._palette != _palette)))
+    {
+        // 调色板放不下新的颜色时先转换字体的格式, 再按新的格式转换
+        if(!encode(data,conv) && (palette_size(_header) == 0 || !promote(data) || !encode(data,conv)))
+            return false;
+        src = &conv;
+    }
+    auto& ref = *src;
     if(ref.size() != size_block(ch,bit(_header)))
     {
         warning("unmatched character data size!");
         return false;
     }
 
-    remove(ch.code);
-
-    _chrs.push_back(ch);
-    auto& it = _chrs.back();
-    it.pos = _data.size();
-    _data.insert(_data.end(),ref.begin(),ref.end());
-    _map[it.code] = &it;
+    detach();
+    Char it = ch;
+    const auto idx = _index.find(ch.code);
+    if(idx != CharIndex::npos)
+    {
+        // 替换已有字符: 数据块大小相同且没有共用则原地覆盖, 否则写入新块, 旧块没有其他引用时作废
+        auto& old = _chrs[idx];
+        const auto sz_old = size_block(old,bit(_header));
+        const bool last = unref(old.pos);
+        if(sz_old == ref.size() && last)
+        {
+            it.pos = old.pos;
+            std::copy(ref.begin(),ref.end(),_data.begin() + it.pos);
+        }
+        else
+        {
+            if(last)
+                _garbage += sz_old;
+            it.pos = (uint32_t)_data.size();
+            _data.insert(_data.end(),ref.begin(),ref.end());
+        }
+        old = it;
+    }
+    else
+    {
+        it.pos = (uint32_t)_data.size();
+        _data.insert(_data.end(),ref.begin(),ref.end());
+        _index.insert(it.code,(uint32_t)_chrs.size());
+        _chrs.push_back(it);
+    }
 
     _header.maxWidth = std::max(_header.maxWidth,ch.width);
-    _header.count = (uint16_t)_chrs.size();
-
+    _header.count = (uint32_t)_chrs.size();
+    if(_editing == 0)
+        shrink();
     return true;
 }
 
 void Font::remove(char32_t ch)
 {
-    auto iter = _map.find(ch);
-    if(iter == _map.end())
+    const auto idx = _index.find(ch);
+    if(idx == CharIndex::npos)
         return;
+    detach();
+
+    // 没有其他字符引用的数据块只标记为作废, 由compact统一回收
+    if(unref(_chrs[idx].pos))
+        _garbage += size_block(_chrs[idx],bit(_header));
+    // 用最后一个字符填补空位
+    _index.erase(ch);
+    const auto last = (uint32_t)_chrs.size() - 1;
+    if(idx != last)
+    {
+        _chrs[idx] = _chrs[last];
+        _index.insert(_chrs[idx].code,idx);
+    }
+    _chrs.pop_back();
+    _header.count = (uint32_t)_chrs.size();
+    if(_editing == 0)
+        shrink();
+}
 
-    const auto& it = *iter->second;
-    const auto pos = it.pos;
-    const auto size = size_block(it,bit(_header));   // 字符data的大小
-    // 删除data块
-    _data.erase(_data.begin() + pos,_data.begin() + pos + size);
-    // 删除map和vector元素
-    _map.erase(iter);
-    for(auto i=_chrs.begin(); i!=_chrs.end(); ++i)
+bool Font::encode(const Data &data, std::vector<uint8_t> &out)
+{
+    const auto w = data.w();
+    const auto h = data.h();
+    const auto fmt = format(_header);
+    const auto stride = (w * bit(_header) + 7) / 8;
+    _palette.resize(palette_size(_header),0);
+    out.assign(stride * h,0);
+    for(int y=0; y<h; ++y)
     {
-        if(i->code == ch)
+        const auto p = out.data() + y * stride;
+        for(int x=0; x<w; ++x)
         {
-            _chrs.erase(i);
-            break;
+            const auto c = data.get(x,y);
+            switch (fmt) {
+            case FL_A1:
+                if(ca(c) >= 128)
+                    p[x >> 3] |= 0x80 >> (x & 7);
+                break;
+            case FL_A8:
+                p[x] = ca(c);
+                break;
+            case FL_BIT32:
+            {
+                const auto v = premul(_header) ? premultiply(c) : c;
+                p[x*4] = ca(v);
+                p[x*4+1] = cr(v);
+                p[x*4+2] = cg(v);
+                p[x*4+3] = cb(v);
+                break;
+            }
+            case FL_PAL4:
+            case FL_PAL8:
+            {
+                const auto end = _palette.begin() + _colors;
+                const auto idx = (uint32_t)(std::find(_palette.begin(),end,c) - _palette.begin());
+                if(idx == _colors)
+                {
+                    if(_colors == _palette.size())
+                        return false;   // 调色板已满, 由insert转换格式
+                    _palette[_colors++] = c;
+                }
+                if(fmt == FL_PAL8)
+                    p[x] = (uint8_t)idx;
+                else
+                    p[x >> 1] |= idx << (x & 1 ? 0 : 4);
+                break;
+            }
+            default:
+                p[x*3] = cr(c);
+                p[x*3+1] = cg(c);
+                p[x*3+2] = cb(c);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool Font::promote(const Data& data)
+{
+    const auto fmt = format(_header);
+    const bool keyed = (_header.flag & FL_KEYED) != 0;
+    // 加入data之后的颜色数
+    std::vector<color> colors(_palette.begin(),_palette.begin() + _colors);
+    for(int y=0; y<data.h() && colors.size() <= 256; ++y)
+    {
+        for(int x=0; x<data.w() && colors.size() <= 256; ++x)
+        {
+            const auto c = data.get(x,y);
+            if(std::find(colors.begin(),colors.end(),c) == colors.end())
+                colors.push_back(c);
+        }
+    }
+    // FL_PAL4够用时转换为FL_PAL8; 否则回到调色板格式的来源: 有透明色的是24位色, 其他是32位色
+    uint8_t to = FL_BIT32;
+    if(fmt == FL_PAL4 && colors.size() <= 256)
+        to = FL_PAL8;
+    else if(keyed)
+        to = 0;
+
+    detach();
+    // 按旧的格式读取每个数据块, 共用的数据块只转换一次
+    Data src;
+    src._palette = _palette;
+    src._fmt = (uint8_t)fmt;
+    src.offset = offset;
+    src.to_color = to_color;
+    const auto b_old = bit(_header);
+    auto old = std::move(_data);
+    _data.clear();
+    _header.flag = (_header.flag & ~(FL_FORMAT | FL_KEYED)) | to | (to == FL_PAL8 && keyed ? FL_KEYED : 0);
+    if(to != FL_PAL8)
+        _colors = 0;
+    prepare();
+    std::unordered_map<uint32_t,Char> done;
+    std::vector<uint8_t> conv;
+    for(auto& it : _chrs)
+    {
+        const auto r = done.find(it.pos);
+        if(r != done.end() && r->second.width == it.width && r->second.height == it.height)
+        {
+            it.pos = r->second.pos;
+            continue;
+        }
+        const auto pos = it.pos;
+        src._w = it.width;
+        src._h = it.height;
+        src._data.assign(old.begin() + pos,old.begin() + pos + size_block(it,b_old));
+        if(!encode(src,conv))
+            return false;   // 不会发生: 目标格式能容纳所有颜色
+        it.pos = (uint32_t)_data.size();
+        _data.insert(_data.end(),conv.begin(),conv.end());
+        done[pos] = it;
+    }
+    _garbage = 0;
+    prepare();
+    return true;
+}
+
+void Font::beginEdit()
+{
+    ++_editing;
+}
+
+void Font::endEdit()
+{
+    if(_editing > 0 && --_editing == 0)
+        shrink();
+}
+
+// 读取/写入字符数据中偏移处的一个像素的原始值, 偏移的单位由bit决定(同fn_offset)
+static inline uint32_t get_pixel(const uint8_t* p,uint32_t i,int bit)
+{
+    switch (bit) {
+    case 1: return (p[i >> 3] >> (7 - (i & 7))) & 1;
+    case 4: return (p[i >> 1] >> (i & 1 ? 0 : 4)) & 0xf;
+    case 8: return p[i];
+    case 24: p += i * 3; return p[0] | (p[1] << 8) | (p[2] << 16);
+    default: { uint32_t v; memcpy(&v,p + i * 4,4); return v; }
+    }
+}
+
+static inline void set_pixel(uint8_t* p,uint32_t i,int bit,uint32_t v)
+{
+    switch (bit) {
+    case 1: p[i >> 3] |= v << (7 - (i & 7)); break;  // 目标已清零
+    case 4: p[i >> 1] |= v << (i & 1 ? 0 : 4); break;
+    case 8: p[i] = (uint8_t)v; break;
+    case 24: p += i * 3; p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); p[2] = uint8_t(v >> 16); break;
+    default: memcpy(p + i * 4,&v,4); break;
+    }
+}
+
+// 每行的像素单位数(按字节对齐后), 用于计算像素偏移
+inline uint32_t pitch(uint32_t w,int bit)
+{ return bit == 1 ? (w + 7) & ~7u : (bit == 4 ? (w + 1) & ~1u : w); }
+
+size_t Font::trim()
+{
+    detach();
+    compact();
+    const auto b = bit(_header);
+    const auto fmt = format(_header);
+    // 带alpha的格式按alpha判断; 24位色和有FL_KEYED的调色板格式还按透明色判断
+    const bool keyed = fmt == 0 || ((fmt == FL_PAL4 || fmt == FL_PAL8) && (_header.flag & FL_KEYED));
+    const auto key = _header.transparent & 0xffffff;
+    auto transparent = [&](color c){
+        return ca(c) == 0 || (keyed && (c & 0xffffff) == key);
+    };
+
+    std::vector<uint8_t> data;
+    data.reserve(_data.size());
+    // 裁剪结果
+    struct crop_t
+    {
+        uint32_t pos;
+        uint16_t w0,h0;  // 原宽高
+        uint16_t l,t,w,h;
+    };
+    auto apply = [](Char& ch,const crop_t& c){
+        ch.pos = c.pos;
+        ch.xoffset += c.l;
+        ch.yoffset += c.t;
+        ch.width = c.w;
+        ch.height = c.h;
+    };
+    // 共用的数据块只裁剪一次: 原地址 -> 裁剪结果
+    std::unordered_map<uint32_t,crop_t> done;
+    for(auto& it : _chrs)
+    {
+        const auto r = done.find(it.pos);
+        if(r != done.end())
+        {
+            const auto& c = r->second;
+            if(c.w0 == it.width && c.h0 == it.height && it.xoffset + c.l <= INT16_MAX && it.yoffset + c.t <= INT16_MAX)
+            {
+                apply(it,c);
+                continue;
+            }
+        }
+
+        // 不透明像素的包围盒
+        const auto src = _data.data() + it.pos;
+        int l = it.width, t = it.height, rt = -1, bm = -1;
+        for(int y=0; y<it.height; ++y)
+        {
+            for(int x=0; x<it.width; ++x)
+            {
+                if(transparent(to_color(src,offset(x,y,it.width),_palette.data())))
+                    continue;
+                l = std::min(l,x);
+                rt = std::max(rt,x);
+                t = std::min(t,y);
+                bm = std::max(bm,y);
+            }
+        }
+        if(rt < 0)
+        {
+            // 完全透明, 保持原样(空格的宽度会被用于排版)
+            l = t = 0;
+            rt = it.width - 1;
+            bm = it.height - 1;
+        }
+        // 偏移不能超出int16
+        l = std::min(l,INT16_MAX - it.xoffset);
+        t = std::min(t,INT16_MAX - it.yoffset);
+        const auto w = rt - l + 1, h = bm - t + 1;
+
+        const crop_t crop{ (uint32_t)data.size(),it.width,it.height,(uint16_t)l,(uint16_t)t,(uint16_t)w,(uint16_t)h };
+        data.resize(data.size() + size_block(w,h,b),0);
+        const auto dst = data.data() + crop.pos;
+        const auto sp = pitch(it.width,b), dp = pitch(w,b);
+        for(int y=0; y<h; ++y)
+        {
+            for(int x=0; x<w; ++x)
+                set_pixel(dst,y * dp + x,b,get_pixel(src,(t + y) * sp + l + x,b));
+        }
+        done.emplace(it.pos,crop);
+        apply(it,crop);
+    }
+
+    const auto saved = data.size() < _data.size() ? _data.size() - data.size() : 0;
+    _data = std::move(data);
+    _garbage = 0;
+    _header.maxWidth = 0;
+    for(auto& it : _chrs)
+        _header.maxWidth = std::max(_header.maxWidth,it.width);
+    prepare();
+    return saved;
+}
+
+void Font::compact()
+{
+    if(_mapping || _garbage == 0)
+        return;
+    const auto b = bit(_header);
+    std::vector<uint8_t> data;
+    data.reserve(_data.size() - std::min(_garbage,_data.size()));
+    // 共用的数据块只复制一次: 原地址 -> (新地址,大小)
+    std::unordered_map<uint32_t,std::pair<uint32_t,uint32_t>> moved;
+    for(auto& it : _chrs)
+    {
+        const auto size = size_block(it,b);
+        if(!_refs.empty())
+        {
+            const auto r = moved.find(it.pos);
+            if(r != moved.end() && r->second.second == size)
+            {
+                it.pos = r->second.first;
+                continue;
+            }
+            moved[it.pos] = { (uint32_t)data.size(),size };
         }
+        const auto beg = _data.begin() + it.pos;
+        it.pos = (uint32_t)data.size();
+        data.insert(data.end(),beg,beg + size);
     }
-    // 其余字符的地址向前偏移
+    _data = std::move(data);
+    _garbage = 0;
+    if(!_refs.empty())
+        count_refs();
+    // 重建索引以恢复直接寻址表
+    _index.build(_chrs.data(),_chrs.size());
+}
+
+// FNV-1a
+static inline uint64_t hash_block(const uint8_t* p,size_t size,uint64_t h = 14695981039346656037ull)
+{
+    for(size_t i=0; i<size; ++i)
+        h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+void Font::dedup()
+{
+    if(_mapping || _pager || _chrs.empty())
+        return;
+    const auto b = bit(_header);
+    // 内容的哈希 -> 已写入的字符; 宽高相同才合并, 保证共用的数据块解释方式相同
+    std::unordered_multimap<uint64_t,Char> seen;
+    seen.reserve(_chrs.size());
+    std::vector<uint8_t> data;
+    data.reserve(_data.size());
+    _refs.clear();
     for(auto& it : _chrs)
     {
-        if(it.pos > pos)
-            it.pos -= size;
+        const auto size = size_block(it,b);
+        const auto src = _data.data() + it.pos;
+        const uint16_t wh[2] = { it.width,it.height };
+        const auto h = hash_block(src,size,hash_block((const uint8_t*)wh,sizeof(wh)));
+        bool found = false;
+        for(auto r = seen.equal_range(h); r.first != r.second; ++r.first)
+        {
+            const auto& o = r.first->second;
+            if(o.width == it.width && o.height == it.height &&
+               memcmp(data.data() + o.pos,src,size) == 0)
+            {
+                it.pos = o.pos;
+                auto& n = _refs[o.pos];
+                n = n == 0 ? 2 : n + 1;
+                found = true;
+                break;
+            }
+        }
+        if(found)
+            continue;
+        const auto pos = (uint32_t)data.size();
+        data.insert(data.end(),src,src + size);
+        it.pos = pos;
+        seen.emplace(h,it);
+    }
+    _data = std::move(data);
+    _garbage = 0;
+    _counted = true;
+}
+
+void Font::count_refs()
+{
+    std::vector<uint32_t> pos(_chrs.size());
+    for(size_t i=0; i<_chrs.size(); ++i)
+        pos[i] = _chrs[i].pos;
+    std::sort(pos.begin(),pos.end());
+    _refs.clear();
+    for(size_t i=0,j; i<pos.size(); i=j)
+    {
+        for(j=i+1; j<pos.size() && pos[j] == pos[i]; ++j);
+        if(j - i > 1)
+            _refs[pos[i]] = uint32_t(j - i);
     }
+    _counted = true;
+}
+
+bool Font::unref(uint32_t pos)
+{
+    const auto r = _refs.find(pos);
+    if(r == _refs.end())
+        return true;
+    if(--r->second == 1)
+        _refs.erase(r);
+    return false;
+}
+
+void Font::shrink()
+{
+    // 作废的数据超过一半时整理, 每次整理的开销由之前的删除/替换分摊
+    if(_garbage > 0 && _garbage * 2 > _data.size())
+        compact();
 }
 
 void Font::clear()
 {
     memset((void*)&_header,0,sizeof(Header));
-    _map.clear();
+    _palette.clear();
+    _colors = 0;
+    _index.clear();
+    _kernings.clear();
+    _kerningHash.clear();
     _chrs.clear();
     _data.clear();
+    _mapping.reset();
+    _vchrs = {};
+    _vdata = {};
+    _pager.reset();
+    _garbage = 0;
+    _refs.clear();
+    _counted = false;
+}
+
+void Font::detach()
+{
+    if(_mapping && _chrs.empty())
+        _chrs.assign(_vchrs.begin(),_vchrs.end());
+    if(_pager)
+    {
+        if(!_pager->readAll(_data))
+            warning("the data has not been fully input!");
+    }
+    else if(_mapping)
+        _data.assign(_vdata.begin(),_vdata.end());
+    _pager.reset();
+    _mapping.reset();
+    _vchrs = {};
+    _vdata = {};
+    if(!_counted)
+        count_refs();
 }
 
 using ctx_compress = context<Compress>;
@@ -317,66 +1788,152 @@ private:
     ctx_compress* _ctx = nullptr;
 };
 
-bool Font::open(const std::string& filename)
+template<typename Rd>
+static inline bool load(Font& that,Rd& _rd,uint64_t avail);
+
+bool Font::open(const std::string& filename,Mode mode)
 {
+    if(mode == MD_MAP)
+        return map(filename);
+    if(mode == MD_LAZY)
+        return page(filename);
     std::ifstream fi(filename, std::ios::binary);
     if (!fi) return false;
-    auto ret = load(fi);
+    // 文件大小已知, 块索引声明的数据不能超出文件
+    fi.seekg(0,std::ios::end);
+    const auto size = (uint64_t)fi.tellg();
+    fi.seekg(0);
+    auto rd = make_reader(fi);
+    auto ret = ck::load(*this,rd,size);
     fi.close();
     return ret;
 }
 
 bool Font::save(const std::string &filename,bool compress)
 {
+    return save(filename,compress ? CP_BLOCK : CP_NONE);
+}
+
+bool Font::save(const std::string &filename,Compress compress,Layout layout)
+{
+    detach();   // 保存的文件可能正是映射的文件, 先复制数据
+    compact();
+    dedup();
     std::ofstream fo(filename,std::ios::binary);
     if(!fo) return false;
     writer wt(&fo);
-    // 写入"文件标签"和"压缩标志"
+
+    _header.count = (uint32_t)_chrs.size();
+    _header.maxWidth = 0;
+    for(auto& it : _chrs)
+    {
+        _header.maxWidth = std::max(_header.maxWidth,it.width);
+    }
+    auto sz_data = (uint32_t)size_data(_chrs,bit(_header));
+    _data.resize(sz_data);  // fit
+
+    // 颜色数允许时保存为调色板格式
+    const Header* header = &_header;
+    const CharList* chrs = &_chrs;
+    const std::vector<uint8_t>* data = &_data;
+    Span<color> palette(_palette.data(),_colors);
+    Header pal_header;
+    CharList pal_chrs;
+    std::vector<uint8_t> pal_data;
+    std::vector<color> pal_colors;
+    if(palettize(_header,_chrs,_data,pal_header,pal_chrs,pal_data,pal_colors))
+    {
+        header = &pal_header;
+        chrs = &pal_chrs;
+        data = &pal_data;
+        palette = pal_colors;
+        sz_data = (uint32_t)pal_data.size();
+    }
+    const bool has_palette = palette_size(*header) > 0;
+
+    // 文件头和字符表, 数值都在范围内时使用紧凑布局
+    if(layout != LO_WIDE && !fits_compact(*header,*chrs))
+        layout = LO_WIDE;
+    std::vector<uint8_t> table;
+    encode_table(*header,*chrs,layout,table);
+
+    // 写入"文件标签"和"压缩方式|布局"
     wt.write("CKF",3);
-    wt.write((char*)&compress,1);
+    const uint8_t mode = uint8_t(compress | (layout << 4));
+    wt.write(&mode,1);
 
     // 压缩
     writer_stream wts(fo);
     ctx_compress ctx;
-    if(compress)
+    if(compress == CP_LZ4)
     {
-        size_t contentSize = 0;
-        contentSize += sizeof(Header);
-        uint32_t sz_data = 0;
-        for(auto& it : _chrs)
-        {
-            contentSize += sizeof(Char);
-            sz_data += size_block(it,bit(_header));
-        }
-        contentSize += sz_data;
+        size_t contentSize = table.size() + sz_data;
+        if(has_palette)
+            contentSize += 4 + palette.size() * sizeof(color);
+        if(header->flag & FL_KERNING)
+            contentSize += 4 + _kernings.size() * sizeof(Kerning);
         ctx = std::move(lz4xx::compress(contentSize,wts));
         wt.attach(&ctx);
     }
 
-    _header.count = (uint32_t)_chrs.size();
-    _header.maxWidth = 0;
-    for(auto& it : _chrs)
+    // 写入文件头和字符信息
+    wt.write(table.data(),table.size());
+    // 写入调色板
+    if(has_palette)
     {
-        _header.maxWidth = std::max(_header.maxWidth,it.width);
+        const auto colors = (uint32_t)palette.size();
+        wt.write(&colors,4);
+        wt.write(palette.data(),colors * sizeof(color));
     }
-    // 写入文件头
-    wt.write(&_header,sizeof(Header));
-    // 写入字符信息
-    uint32_t sz_data = 0;
-    for(auto& it : _chrs)
+    // 写入字距调整表
+    if(header->flag & FL_KERNING)
+    {
+        const auto count = (uint32_t)_kernings.size();
+        wt.write(&count,4);
+        wt.write(_kernings.data(),count * sizeof(Kerning));
+    }
+
+    if(compress == CP_BLOCK)
     {
-        wt.write(&it,sizeof(Char));
-        sz_data += size_block(it,bit(_header));
+        // 写入块索引和各个独立压缩的块
+        auto blocks = split_blocks(*chrs,bit(*header));
+        std::vector<buffer_t> packs(blocks.size());
+        std::atomic<bool> ok{ true };
+        parallel_for(blocks.size(),[&](size_t i){
+            auto& b = blocks[i];
+            if(compress_block(data->data() + b.pos,b.size,packs[i]))
+                b.packed = (uint32_t)packs[i].size();
+            else
+                ok = false;
+        });
+        if(!ok)
+        {
+            warning("failed to compress the data!");
+            return false;
+        }
+        const auto count = (uint32_t)blocks.size();
+        wt.write(&count,4);
+        for(auto& b : blocks)
+        {
+            wt.write(&b.size,4);
+            wt.write(&b.packed,4);
+        }
+        for(auto& it : packs)
+        {
+            if(!wt.write(it.data(),it.size()))
+            {
+                warning("the data has not been fully output!");
+                return false;
+            }
+        }
     }
-    // 写入字符数据
-    _data.resize(sz_data);  // fit
-    if(!wt.write(_data.data(),sz_data))
+    else if(!wt.write(data->data(),sz_data))   // 写入字符数据
     {
         warning("the data has not been fully output!");
         return false;
     }
 
-    if(compress)
+    if(compress == CP_LZ4)
         ctx.finish();
 
     fo.close();
@@ -388,45 +1945,23 @@ template<typename Rd>
 struct reader : bio::ireader
 {
     inline reader(Rd* rd) :
-        _rd(rd),
-        _rdb(nullptr)
+        _rd(rd)
     {}
 
-    using Rdb = bio::reader<bio::Buffer>;
-    inline void attach(Rdb* rdb) {
-        _rd = nullptr;
-        _rdb = rdb;
-    }
-
     inline size_t read(uint8_t *data, size_t capacity) override {
-        if(_rdb)
-            return _rdb->read(data,capacity);
-        else if(_rd)
-            return _rd->read(data,capacity);
-        return 0;
+        return _rd->read(data,capacity);
     }
 
     inline size_t seek(pos_t pos) override {
-        if(_rdb)
-            return _rdb->seek(pos);
-        else if(_rd)
-            return _rd->seek(pos);
-        return 0;
+        return _rd->seek(pos);
     }
 
     inline size_t pos() const override {
-        if(_rdb)
-            return _rdb->pos();
-        else if(_rd)
-            return _rd->pos();
-        return 0;
+        return _rd->pos();
     }
 
-    inline size_t offset(pos_t ofs) override
-    {
-        if(_rd) return _rd->offset(ofs);
-        else if(_rdb) return _rdb->offset(ofs);
-        return 0;
+    inline size_t offset(pos_t ofs) override {
+        return _rd->offset(ofs);
     }
 
     template<typename T>
@@ -434,57 +1969,204 @@ struct reader : bio::ireader
     { return read((uint8_t*)data,size); }
 private:
     Rd* _rd = nullptr;
-    Rdb* _rdb = nullptr;
 };
 
-// 计算每个字符的地址是否在数据的范围之内, 以及data大小是否匹配
-static bool validate(const std::vector<Char>& chrs, uint32_t size,int bit)
+// 把解压的数据依次写入 文件头/字符表/调色板/图像数据, 不经过中间缓冲
+// 字符表写完后才知道图像数据的大小
+struct writer_font : bio::iwriter
+{
+    inline writer_font(int layout,Header& header,CharList& chrs,std::vector<color>& palette,uint32_t& colors,
+                       KerningList& kernings,std::vector<uint8_t>& data)
+        : _layout(layout),_header(header),_chrs(chrs),_palette(palette),_colors(colors),_kernings(kernings),_data(data)
+    {
+        _raw.resize(size_header(_layout));
+    }
+
+    size_t write(const uint8_t* data,size_t size) override
+    {
+        const auto total = size;
+        while(size > 0 && _part < PT_END)
+        {
+            uint8_t* dst = nullptr;
+            size_t cap = 0;
+            switch (_part) {
+            case PT_HEADER: dst = _raw.data(); cap = _raw.size(); break;
+            case PT_CHARS:  // 按实际收到的数据增长, 不按文件头中的数量预先分配; 写完后转换到字符表
+                cap = (size_t)_header.count * size_char(_layout);
+                _raw.resize(std::min(cap,_filled + size));
+                dst = _raw.data();
+                break;
+            case PT_COLORS: dst = (uint8_t*)&_colors; cap = 4; break;
+            case PT_PALETTE: dst = (uint8_t*)_palette.data(); cap = _colors * sizeof(color); break;
+            case PT_KERNING_COUNT: dst = (uint8_t*)&_kerningCount; cap = 4; break;
+            case PT_KERNINGS: dst = (uint8_t*)_kernings.data(); cap = _kernings.size() * sizeof(Kerning); break;
+            case PT_DATA:   // 同上, 大小由字符表决定
+                cap = _sizeData;
+                _data.resize(std::min(cap,_filled + size));
+                dst = _data.data();
+                break;
+            }
+            const auto n = std::min(size,cap - _filled);
+            memcpy(dst + _filled,data,n);
+            _filled += n;
+            data += n;
+            size -= n;
+            if(_filled == cap)
+                next();
+        }
+        _overflow += size;
+        return total;
+    }
+
+    // 是否恰好写完全部内容
+    inline bool complete() const
+    { return _part == PT_END && _overflow == 0; }
+private:
+    enum Part { PT_HEADER, PT_CHARS, PT_COLORS, PT_PALETTE, PT_KERNING_COUNT, PT_KERNINGS, PT_DATA, PT_END };
+
+    // 进入下一部分, 跳过大小为0的部分
+    void next()
+    {
+        _filled = 0;
+        switch (_part) {
+        case PT_HEADER:
+            decode_header(_raw.data(),_layout,_header);
+            _raw.clear();
+            _palette.assign(palette_size(_header),0);
+            _part = PT_CHARS;
+            if(_header.count == 0)
+                next();
+            break;
+        case PT_CHARS:
+            _chrs.resize(_header.count);
+            decode_chars(_raw.data(),_chrs.size(),_layout,_chrs.data());
+            _raw.clear();
+            _raw.shrink_to_fit();
+            _part = _palette.empty() ? PT_PALETTE : PT_COLORS;
+            if(_part == PT_PALETTE)
+                next();
+            break;
+        case PT_COLORS:
+            if(_colors > _palette.size())   // 调色板损坏, 之后的数据都算溢出
+            {
+                _part = PT_END;
+                _overflow = 1;
+                break;
+            }
+            _part = PT_PALETTE;
+            if(_colors == 0)
+                next();
+            break;
+        case PT_PALETTE:
+            _part = PT_KERNING_COUNT;
+            if(!(_header.flag & Font::FL_KERNING))
+                next();
+            break;
+        case PT_KERNING_COUNT:
+            // 没有FL_KERNING时跳过, 数量为0
+            if(_kerningCount > KERNING_MAX)
+            {
+                _part = PT_END;
+                _overflow = 1;
+                break;
+            }
+            _kernings.resize(_kerningCount);
+            _part = PT_KERNINGS;
+            if(_kernings.empty())
+                next();
+            break;
+        case PT_KERNINGS:
+        {
+            _data.clear();
+            _sizeData = size_data(_chrs,bit(_header));
+            _part = PT_DATA;
+            if(_sizeData == 0)
+                next();
+            break;
+        }
+        default:
+            _part = PT_END;
+            break;
+        }
+    }
+
+    int _layout;
+    std::vector<uint8_t> _raw;  // 文件头和紧凑布局的字符表
+    Header& _header;
+    CharList& _chrs;
+    std::vector<color>& _palette;
+    uint32_t& _colors;
+    KerningList& _kernings;
+    uint32_t _kerningCount = 0;
+    std::vector<uint8_t>& _data;
+    size_t _sizeData = 0;
+    int _part = PT_HEADER;
+    size_t _filled = 0;
+    size_t _overflow = 0;
+};
+
+// 计算每个字符的地址是否在数据的范围之内, 以及data大小是否匹配; 数据块可以被多个字符共用
+static bool validate(Font::CharSpan chrs, size_t size,int bit)
 {
-    uint32_t total = 0;  // 统计data应该的大小
     for(auto& it : chrs)
     {
-        auto sz_block = size_block(it,bit);
-        total += sz_block;
-        if(it.pos + sz_block > size) // 判断地址溢出
+        if(size_block64(it,bit) > UINT32_MAX)
             return false;
     }
-    return total == size;
+    return size_data(chrs,bit) == size;
 }
 
 bool Font::load(const Adapter& adp)
 {
+    clear();
     _chrs = adp.charList();
     _data = adp.data();
-    _map.clear();
-
     _header = adp.header();
+    _palette = adp.palette();
+    _kernings = adp.kernings();
+    if(!adopt())
+        return false;
+    _chrs.shrink_to_fit();
+    _data.shrink_to_fit();
+    return true;
+}
+
+bool Font::load(Adapter&& adp)
+{
+    clear();
+    // 移动后vector的内存归字体所有, 不再shrink_to_fit, 避免重新分配和复制
+    _chrs = std::move(adp._chrs);
+    _data = std::move(adp._data);
+    _header = adp._header;
+    _palette = std::move(adp._palette);
+    _kernings = std::move(adp._kernings);
+    adp._chrs.clear();
+    adp._data.clear();
+    adp._palette.clear();
+    adp._kernings.clear();
+    return adopt();
+}
+
+bool Font::adopt()
+{
+    _colors = (uint32_t)_palette.size();
+    if(_colors > palette_size(_header))
+    {
+        warning("illegal palette!");
+        clear();
+        return false;
+    }
     _header.maxWidth = 0;
     for(auto& it : _chrs)
     {
         _header.maxWidth = std::max(_header.maxWidth,it.width);
     }
-    if(_header.flag & FL_BIT32)
-    {
-        offset = offset_32;
-        to_color = to_color_32;
-    }
-    else
-    {
-        offset = offset_24;
-        to_color = to_color_24;
-    }
 
     if(validate(_chrs,_data.size(),bit(_header)))
     {
-        _chrs.shrink_to_fit();
-        _data.shrink_to_fit();
-        for(auto& it : _chrs)
-        {
-            _map[it.code] = &it;
-        }
-        // 缺省空格的宽度是行高的一半
-        _sp.width = std::max(_header.lineHeight / 2,2);
-        _sp.height = _header.lineHeight;
+        if(premul(_header))
+            convert_premul(_data.data(),_data.size(),true);
+        prepare();
         return true;
     }
     else
@@ -496,26 +2178,86 @@ bool Font::load(const Adapter& adp)
     }
 }
 
+// 流式读取时每次最多读取的未压缩数据大小
+static constexpr size_t STREAM_CHUNK = 1024 * 1024;
+
+// 只向前读取size字节的图像数据, 内存随实际读到的数据增长, 不会因为损坏的字符表预先分配过大的内存
 template<typename Rd>
-static inline bool load(Font& that,Rd& _rd)
+static bool stream_data(reader<Rd>& rd,uint64_t size,std::vector<uint8_t>& data)
+{
+    data.clear();
+    while(data.size() < size)
+    {
+        const auto beg = data.size();
+        const auto n = (size_t)std::min<uint64_t>(size - beg,std::max(STREAM_CHUNK,beg));
+        data.resize(beg + n);
+        if(rd.read(data.data() + beg,n) < n)
+            return false;
+    }
+    return true;
+}
+
+// 只向前读取并解压CP_BLOCK的数据块
+// 读取一批数据块的同时在后台线程解压上一批, 最多同时持有两批压缩数据
+template<typename Rd>
+static bool stream_blocks(reader<Rd>& rd,const Blocks& blocks,std::vector<uint8_t>& data)
+{
+    size_t threads = g_threads.load();
+    if(threads == 0)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+    const auto limit = threads * 2 * BLOCK_SIZE;  // 每批压缩数据的上限
+
+    // 压缩数据和图像数据都随实际读到的数据增长, 不按块索引声明的大小预先分配
+    data.clear();
+    std::vector<uint8_t> packed[2];
+    std::atomic<bool> ok{ true };
+    std::thread worker;
+    size_t beg = 0;
+    for(int k=0; beg < blocks.size(); k ^= 1)
+    {
+        // 划分一批数据块, 至少包含一块
+        size_t end = beg + 1;
+        while(end < blocks.size() && blocks[end].offset + blocks[end].packed - blocks[beg].offset <= limit)
+            ++end;
+        auto& buf = packed[k];
+        const bool complete = stream_data(rd,blocks[end - 1].offset + blocks[end - 1].packed - blocks[beg].offset,buf);
+        if(worker.joinable())
+            worker.join();
+        if(!complete || !ok)
+            return false;
+        // 后台线程已结束, 可以扩大图像数据
+        data.resize((size_t)blocks[end - 1].pos + blocks[end - 1].size);
+        worker = std::thread([&blocks,&buf,&data,&ok,beg,end](){
+            const auto base = blocks[beg].offset;
+            parallel_for(end - beg,[&](size_t i){
+                const auto& b = blocks[beg + i];
+                if((uint64_t)b.pos + b.size > data.size() ||
+                   !decompress_block(buf.data() + (b.offset - base),b.packed,data.data() + b.pos,b.size))
+                    ok = false;
+            });
+        });
+        beg = end;
+    }
+    if(worker.joinable())
+        worker.join();
+    return ok;
+}
+
+// 只向前读取, 输入可以是管道等不可定位的流
+// @avail 输入的总字节数, 未知时为UINT64_MAX; 已知时块索引声明的数据不能超出输入
+template<typename Rd>
+static inline bool load(Font& that,Rd& _rd,uint64_t avail)
 {
-    auto size = _rd.seek(-1);
-    _rd.seek(0);
-    if(size < sizeof(Header) + 4)  // 至少有一个头大小
-        return false;
-    auto& map = that._map;
     auto& chrs = that._chrs;
     auto& data = that._data;
     auto& header = that._header;
-    map.clear();
-    chrs.clear();
-    data.clear();
+    that.clear();
 
     reader<Rd> rd(&_rd);
     char tag[3];
-    rd.read(tag,3);
-    bool compressed = false;
-    rd.read(&compressed,1);
+    uint8_t mode = 0;
+    if(rd.read(tag,3) < 3 || rd.read(&mode,1) < 1)
+        return false;
 
     if(strncmp(tag,"CKF",3) != 0)
     {
@@ -523,73 +2265,93 @@ static inline bool load(Font& that,Rd& _rd)
         return false;
     }
 
-    buffer_t buf;
-    reader_buffer rdb(&buf);
-    if(compressed)
-    {
-        writer_buffer wtb(buf);
-        lz4xx::decompress(rd,wtb);
-        rd.attach(&rdb);
-    }
-    const auto beg = rd.pos();
-    size = rd.seek(-1); // 重读大小
-    rd.seek(beg);
-    rd.read(&header,sizeof(Header));
-    if(header.flag & Font::FL_BIT32)
-    {
-        that.offset = offset_32;
-        that.to_color = to_color_32;
-    }
-    else
+    const auto compress = compress_of(mode);
+    const auto layout = layout_of(mode);
+    if(layout > Font::LO_WIDE)
     {
-        that.offset = offset_24;
-        that.to_color = to_color_24;
+        warning("unsupported layout!");
+        return false;
     }
 
-    if(header.count > 0)
+    if(compress == Font::CP_LZ4)
     {
-        // 读取字符信息
-        chrs.reserve(header.count);
-        Char c;
-        uint32_t offset = sizeof(Header);
-        int num = 0;
-        while (num < header.count && offset < size)
+        // 直接解压到文件头/字符表/调色板/图像数据
+        writer_font wtf(layout,header,chrs,that._palette,that._colors,that._kernings,data);
+        lz4xx::decompress(rd,wtf);
+        if(!wtf.complete())
         {
-            rd.read((char*)&c,sizeof(Char));
-            offset += sizeof(Char);
-            chrs.push_back(c);
-            ++num;
+            warning("the data has not been fully input!");
+            chrs.clear();
+            data.clear();
+            return false;
         }
-        if(num != header.count)
+    }
+    else if(compress == Font::CP_NONE || compress == Font::CP_BLOCK)
+    {
+        uint8_t raw[sizeof(Header)];
+        const auto sz_header = size_header(layout);
+        if(rd.read(raw,sz_header) < sz_header)
+            return false;
+        decode_header(raw,layout,header);
+        // 输入的大小未知, 字符表随读到的数据增长
+        auto read = [&rd](void* out,size_t size){ return rd.read(out,size) == size; };
+        if(!read_chars(read,layout,header.count,chrs))
         {
             warning("characters overflowed, maybe font was broken!");
             chrs.clear();
             return false;
         }
-
-        // 读取字符图像数据
-        const auto sz_data = size - rd.pos();
-        if(sz_data > 0)
+        if(!read_palette(read,header,that._palette,that._colors))
+        {
+            warning("illegal palette!");
+            chrs.clear();
+            return false;
+        }
+        if(!read_kernings(read,header,that._kernings))
+        {
+            warning("illegal kerning table!");
+            chrs.clear();
+            return false;
+        }
+        if(header.count > 0)
         {
-            data.resize(sz_data);
-            if(rd.read(data.data(),sz_data) < sz_data)
+            bool ok;
+            if(compress == Font::CP_BLOCK)
+            {
+                Blocks blocks;
+                const auto pos = avail == UINT64_MAX ? 0 : (uint64_t)rd.pos();
+                if(!read_blocks(read,blocks,avail - std::min(avail,pos)))
+                {
+                    warning("illegal block index!");
+                    chrs.clear();
+                    return false;
+                }
+                ok = stream_blocks(rd,blocks,data);
+            }
+            else
+            {
+                // 图像数据的大小由字符表决定
+                ok = stream_data(rd,size_data(chrs,bit(header)),data);
+            }
+            if(!ok)
             {
                 warning("the data has not been fully input!");
+                chrs.clear();
+                data.clear();
                 return false;
             }
         }
     }
+    else
+    {
+        warning("unsupported compression!");
+        return false;
+    }
     if(validate(chrs,data.size(),bit(header)))
     {
         chrs.shrink_to_fit();
         data.shrink_to_fit();
-        for(auto& it : chrs)
-        {
-            map[it.code] = &it;
-        }
-        // 缺省空格的宽度是行高的一半
-        that._sp.width = std::max(header.lineHeight / 2,2);
-        that._sp.height = header.lineHeight;
+        that.prepare();
         return true;
     }
     else
@@ -604,38 +2366,273 @@ static inline bool load(Font& that,Rd& _rd)
 bool Font::load(std::istream &si)
 {
     auto rd = make_reader(si);
-    return ck::load(*this,rd);
+    return ck::load(*this,rd,UINT64_MAX);
 }
 
 bool Font::load(const uint8_t *data, uint32_t size)
 {
     auto rd = make_reader(data,size);
-    return ck::load(*this,rd);
+    return ck::load(*this,rd,size);
+}
+
+bool Font::load(const uint8_t *data, uint32_t size, Mode mode)
+{
+    if(mode == MD_COPY)
+        return load(data,size);
+    if(data == nullptr)
+        return false;
+    return map(Mapping::borrow(data,size));
+}
+
+bool Font::map(const std::string &filename)
+{
+    auto mapping = Mapping::open(filename);
+    if(!mapping)
+        return false;
+    return map(std::move(mapping));
+}
+
+bool Font::map(std::shared_ptr<const Mapping> mapping)
+{
+    const auto ptr = mapping->ptr;
+    const auto size = mapping->size;
+    if(size < 4 || strncmp((const char*)ptr,"CKF",3) != 0)
+    {
+        warning("illegal file tag!");
+        return false;
+    }
+    const auto compress = compress_of(ptr[3]);
+    const auto layout = layout_of(ptr[3]);
+    // 整体压缩的文件无法直接引用, 读取到内存
+    if((compress != CP_NONE && compress != CP_BLOCK) || layout > LO_WIDE)
+        return load(ptr,(uint32_t)size);
+    const auto sz_header = size_header(layout);
+    if(size < sz_header + 4)  // 至少有一个头大小
+        return false;
+
+    clear();
+    decode_header(ptr + 4,layout,_header);
+    const auto chrs = ptr + 4 + sz_header;
+    const auto sz_chrs = (uint64_t)_header.count * size_char(layout);
+    if(sz_chrs > size - 4 - sz_header)
+    {
+        warning("characters overflowed, maybe font was broken!");
+        clear();
+        return false;
+    }
+    CharSpan table;
+    if(layout == LO_WIDE)
+    {
+        if((uintptr_t)chrs % alignof(Char) != 0)    // 映射地址按页对齐, 正常只有外部内存未对齐
+            return load(ptr,(uint32_t)size);
+        // 字符表直接引用映射内存
+        _vchrs = { (const Char*)chrs, _header.count };
+        table = _vchrs;
+    }
+    else
+    {
+        // 紧凑布局的字符表与Char不同, 解码到内存, 图像数据仍然引用映射内存
+        _chrs.resize(_header.count);
+        decode_chars(chrs,_header.count,layout,_chrs.data());
+        table = _chrs;
+    }
+    auto rest = chrs + sz_chrs;
+    auto remain = size - 4 - sz_header - (size_t)sz_chrs;
+    auto rd = [&rest,&remain](void* out,size_t size){
+        if(size > remain) return false;
+        memcpy(out,rest,size);
+        rest += size;
+        remain -= size;
+        return true;
+    };
+    // 调色板很小, 复制到内存
+    if(!read_palette(rd,_header,_palette,_colors))
+    {
+        warning("illegal palette!");
+        clear();
+        return false;
+    }
+    if(!read_kernings(rd,_header,_kernings))
+    {
+        warning("illegal kerning table!");
+        clear();
+        return false;
+    }
+    size_t sz_data = remain;
+    if(compress == CP_BLOCK)
+    {
+        // 图像数据按块解压, 压缩数据直接引用映射内存
+        Blocks blocks;
+        if(!read_blocks(rd,blocks,remain))
+        {
+            warning("illegal block index!");
+            clear();
+            return false;
+        }
+        sz_data = size_blocks(blocks);
+        _pager = std::make_shared<Pager>(mapping,rest,remain,_cacheSize);
+        _pager->setBlocks(std::move(blocks));
+    }
+    else
+        _vdata = { rest, remain };
+    if(!validate(table,sz_data,bit(_header)))
+    {
+        warning("font validation failed!");
+        clear();
+        return false;
+    }
+    _mapping = std::move(mapping);
+    prepare();
+    return true;
+}
+
+bool Font::page(const std::string &filename)
+{
+    std::ifstream fi(filename, std::ios::binary);
+    if (!fi) return false;
+    fi.seekg(0,std::ios::end);
+    const auto size = (uint64_t)fi.tellg();  // 文件大小, 用于检查文件中的数量
+    fi.seekg(0);
+    char tag[4];
+    if(!fi.read(tag,4))
+        return false;
+    if(strncmp(tag,"CKF",3) != 0)
+    {
+        warning("illegal file tag!");
+        return false;
+    }
+    const auto compress = compress_of((uint8_t)tag[3]);
+    const auto layout = layout_of((uint8_t)tag[3]);
+    if(compress != CP_NONE && compress != CP_BLOCK)    // 整体压缩的文件无法随机读取, 解压到内存
+    {
+        fi.seekg(0);
+        return load(fi);
+    }
+    if(layout > LO_WIDE)
+    {
+        warning("unsupported layout!");
+        return false;
+    }
+
+    clear();
+    std::vector<uint8_t> raw(size_header(layout));
+    if(!fi.read((char*)raw.data(),raw.size()))
+        return false;
+    decode_header(raw.data(),layout,_header);
+    auto rd = [&fi](void* out,size_t size){ return (bool)fi.read((char*)out,size); };
+    // 字符数先与文件剩余的大小比较, 再分配
+    if((uint64_t)_header.count * size_char(layout) > size - (uint64_t)fi.tellg() ||
+        !read_chars(rd,layout,_header.count,_chrs))
+    {
+        warning("characters overflowed, maybe font was broken!");
+        clear();
+        return false;
+    }
+    if(!read_palette(rd,_header,_palette,_colors))
+    {
+        warning("illegal palette!");
+        clear();
+        return false;
+    }
+    if(!read_kernings(rd,_header,_kernings))
+    {
+        warning("illegal kerning table!");
+        clear();
+        return false;
+    }
+    Blocks blocks;
+    if(compress == CP_BLOCK && !read_blocks(rd,blocks,size - (uint64_t)fi.tellg()))
+    {
+        warning("illegal block index!");
+        clear();
+        return false;
+    }
+    const auto start = (uint64_t)fi.tellg();
+    fi.seekg(0,std::ios::end);
+    const auto remain = (size_t)((uint64_t)fi.tellg() - start);
+    if(compress == CP_BLOCK && packed_blocks(blocks) > remain)
+    {
+        warning("illegal block index!");
+        clear();
+        return false;
+    }
+    const auto sz_data = compress == CP_BLOCK ? size_blocks(blocks) : remain;
+    if(!validate(_chrs,sz_data,bit(_header)))
+    {
+        warning("font validation failed!");
+        clear();
+        return false;
+    }
+    _pager = std::make_shared<Pager>(std::move(fi),start,remain,_cacheSize);
+    if(compress == CP_BLOCK)
+        _pager->setBlocks(std::move(blocks));
+    prepare();
+    return true;
+}
+
+void Font::prepare()
+{
+    switch (format(_header)) {
+    case FL_A1: offset = offset_1; to_color = to_color_1; break;
+    case FL_A8: offset = offset_8; to_color = to_color_8; break;
+    case FL_PAL4: offset = offset_4; to_color = to_color_p4; break;
+    case FL_PAL8: offset = offset_8; to_color = to_color_p8; break;
+    case FL_BIT32: offset = offset_32; to_color = premul(_header) ? to_color_32p : to_color_32; break;
+    default: offset = offset_24; to_color = to_color_24; break;
+    }
+    _palette.resize(palette_size(_header),0);
+    const auto chs = chrs();
+    _index.build(chs.data(),chs.size());
+    _refs.clear();
+    _counted = false;
+    index_kernings();
+    // 缺省空格的宽度是行高的一半
+    _sp.width = std::max(_header.lineHeight / 2,2);
+    _sp.height = _header.lineHeight;
+}
+
+void Font::setThreads(unsigned n)
+{
+    g_threads = n;
 }
 
 bool Font::valid() const
 {
-    return !_chrs.empty();
+    return !chrs().empty();
+}
+
+bool Font::mapped() const
+{
+    return _mapping != nullptr;
+}
+
+bool Font::paged() const
+{
+    return _pager != nullptr;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// DataPtr
 Font::DataPtr::DataPtr()
-    : _ptr(nullptr),_w(0),_h(0),
+    : _ptr(nullptr),_w(0),_h(0),_fmt(0),_keyed(false),_key(0),
     offset(nullptr),
     to_color(nullptr)
 {}
 
 Font::DataPtr::DataPtr(Data &data)
-    : _ptr(data._data.data()),_w(data._w),_h(data._h),
+    : _ptr(data._data.data()),_palette(data._palette),_w(data._w),_h(data._h),_fmt(data._fmt),
+    _keyed(data._keyed),_key(data._key),
     offset(data.offset),
     to_color(data.to_color)
 {}
 
-Font::DataPtr::DataPtr(const Font* fnt,const uint8_t *ptr, uint8_t w, uint8_t h)
-    : _ptr(ptr),_w(w),_h(h),
+Font::DataPtr::DataPtr(const Font* fnt,const uint8_t *ptr, uint16_t w, uint16_t h,std::shared_ptr<const void> pin)
+    : _ptr(ptr),_palette(fnt->palette()),_w(w),_h(h),_fmt((uint8_t)ck::format(fnt->_header)),
+    _keyed(_fmt == 0 || (palette_size(fnt->_header) > 0 && (fnt->_header.flag & FL_KEYED))),
+    _key(fnt->_header.transparent & 0xffffff),
     offset(fnt->offset),
-    to_color(fnt->to_color)
+    to_color(fnt->to_color),
+    _pin(std::move(pin))
 {}
 
 const uint8_t* Font::DataPtr::ptr() const
@@ -646,7 +2643,12 @@ const uint8_t* Font::DataPtr::ptr() const
 color Font::DataPtr::get(int x, int y) const
 {
     if(!valid()) return 0;
-    return to_color(_ptr + offset(x,y,_w));
+    return to_color(_ptr,offset(x,y,_w),_palette.data());
+}
+
+bool Font::DataPtr::premultiplied() const
+{
+    return to_color == to_color_32p;
 }
 
 bool Font::DataPtr::valid() const
@@ -655,17 +2657,134 @@ bool Font::DataPtr::valid() const
            offset != nullptr && to_color != nullptr;
 }
 
+uint32_t Font::DataPtr::stride() const
+{
+    if(!valid()) return 0;
+    return size_block(_w,1,bit(offset));
+}
+
+Span<uint8_t> Font::DataPtr::row(int y) const
+{
+    const auto n = stride();
+    if(n == 0 || y < 0 || y >= _h) return {};
+    return { _ptr + y * n, n };
+}
+
+// 把一行像素解码为color
+template<typename Fmt>
+static inline void unpack_row(const uint8_t* src,int w,const color* palette,color* out)
+{
+    for(int x=0; x<w; ++x)
+        out[x] = Fmt::get(src,x,palette);
+}
+
+// argb字节序 -> color, 按运行时选择的指令集(blend.h)
+template<>
+inline void unpack_row<fmt::ARGB32>(const uint8_t* src,int w,const color*,color* out)
+{
+    unpackArgb(src,out,w);
+}
+
+template<>
+inline void unpack_row<fmt::PARGB32>(const uint8_t* src,int w,const color* palette,color* out)
+{
+    unpack_row<fmt::ARGB32>(src,w,palette,out);
+    for(int x=0; x<w; ++x)
+        out[x] = unpremultiply(out[x]);
+}
+
+template<>
+inline void unpack_row<fmt::A8>(const uint8_t* src,int w,const color*,color* out)
+{
+    for(int x=0; x<w; ++x)
+        out[x] = ((uint32_t)src[x] << 24) | 0xffffff;
+}
+
+// 把一行color编码为pf格式, *_PREMUL格式的颜色应已预乘; in可能被修改
+static inline void pack_row(color* in,int w,uint8_t* dst,Font::PixelFormat pf)
+{
+    switch (pf) {
+    case Font::PF_BGRA8:    // 小端的color就是BGRA
+    case Font::PF_BGRA8_PREMUL:
+        memcpy(dst,in,w * 4);
+        break;
+    case Font::PF_RGBA8:
+    case Font::PF_RGBA8_PREMUL:
+        swapRedBlue(in,w);
+        memcpy(dst,in,w * 4);
+        break;
+    case Font::PF_A8:
+        for(int x=0; x<w; ++x)
+            dst[x] = uint8_t(in[x] >> 24);
+        break;
+    case Font::PF_RGB565:
+        for(int x=0; x<w; ++x)
+        {
+            const auto c = in[x];
+            const uint16_t v = ((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x1f);
+            dst[x * 2] = uint8_t(v);
+            dst[x * 2 + 1] = uint8_t(v >> 8);
+        }
+        break;
+    }
+}
+
+bool Font::DataPtr::copyTo(void *dst, size_t dstStride, PixelFormat pf) const
+{
+    if(dst == nullptr || pf < PF_BGRA8 || pf > PF_RGBA8_PREMUL)
+        return false;
+    const bool to_premul = pf == PF_BGRA8_PREMUL || pf == PF_RGBA8_PREMUL;
+    // 每个字符只按格式分派一次, 逐行先解码再编码
+    return visit(*this,[&](auto view){
+        using Fmt = typename decltype(view)::format;
+        // 一行的颜色, 通常在栈上, 超宽的字符才分配
+        color stack[256];
+        std::vector<color> heap;
+        if(view.w() > 256)
+            heap.resize(view.w());
+        const auto buf = heap.empty() ? stack : heap.data();
+        auto out = (uint8_t*)dst;
+        for(int y=0; y<view.h(); ++y,out += dstStride)
+        {
+            if constexpr (std::is_same_v<Fmt,fmt::PARGB32>)
+            {
+                // 已经是预乘的颜色, 不需要还原后再预乘
+                if(to_premul)
+                    unpack_row<fmt::ARGB32>(view.row(y),view.w(),view.palette(),buf);
+                else
+                    unpack_row<Fmt>(view.row(y),view.w(),view.palette(),buf);
+            }
+            else
+            {
+                unpack_row<Fmt>(view.row(y),view.w(),view.palette(),buf);
+                // 透明色转换为alpha为0, 预乘后是0
+                if(_keyed)
+                {
+                    for(int x=0; x<view.w(); ++x)
+                    {
+                        if((buf[x] & 0xffffff) == _key)
+                            buf[x] = _key;
+                    }
+                }
+                if(to_premul)
+                    premultiply(buf,view.w());
+            }
+            pack_row(buf,view.w(),out,pf);
+        }
+    });
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Data
 Font::Data::Data()
-    : _w(0),_h(0),
+    : _w(0),_h(0),_fmt(0),_keyed(false),_key(0),
     offset(nullptr),
     to_color(nullptr)
 {}
 
 Font::Data::Data(const DataPtr &o)
-    : _w(0),_h(0),
+    : _w(0),_h(0),_fmt(o._fmt),_keyed(o._keyed),_key(o._key),
     offset(o.offset),
     to_color(o.to_color)
 {
@@ -674,7 +2793,8 @@ Font::Data::Data(const DataPtr &o)
 
 Font::Data::Data(Data &&o)
     : _data(std::move(o._data)),
-    _w(o._w),_h(o._h),
+    _palette(std::move(o._palette)),
+    _w(o._w),_h(o._h),_fmt(o._fmt),_keyed(o._keyed),_key(o._key),
     offset(o.offset),
     to_color(o.to_color)
 {
@@ -692,7 +2812,12 @@ const uint8_t* Font::Data::ptr() const
 color Font::Data::get(int x, int y) const
 {
     if(!valid()) return 0;
-    return to_color(_data.data() + offset(x,y,_w));
+    return to_color(_data.data(),offset(x,y,_w),_palette.data());
+}
+
+bool Font::Data::premultiplied() const
+{
+    return to_color == to_color_32p;
 }
 
 bool Font::Data::valid() const
@@ -707,14 +2832,18 @@ void Font::Data::operator=(const DataPtr &o)
     {
         _w = o._w;
         _h = o._h;
-        uint32_t size = 0;
-        if(o.offset == offset_24)
-            size = _w * _h * 3;
-        else
-            size = _w * _h * 4;
+        _fmt = o._fmt;
+        _keyed = o._keyed;
+        _key = o._key;
+        offset = o.offset;
+        to_color = o.to_color;
+        const auto size = size_block(_w,_h,bit(o.offset));
         _data.resize(size);
         memcpy(_data.data(),o._ptr,size);
+        _palette.assign(o._palette.begin(),o._palette.end());
     }
+    else
+        _palette.clear();
     _data.shrink_to_fit();
 }
 
@@ -741,4 +2870,14 @@ const std::vector<uint8_t> &Font::Adapter::data() const
     return _data;
 }
 
+const std::vector<color> &Font::Adapter::palette() const
+{
+    return _palette;
+}
+
+const Font::KerningList &Font::Adapter::kernings() const
+{
+    return _kernings;
+}
+
 }
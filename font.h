@@ -16,10 +16,16 @@
 #define CK_FONT_H
 
 #include <cstdint>
+#include <cmath>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <memory>
+#include <iterator>
 #include <functional>
+#include "char_index.h"
 
 namespace ck
 {
@@ -51,49 +57,116 @@ inline uint8_t cb(color c)
 template<typename T>
 inline uint8_t clamp(T v)
 {
-    v = round(v);
+    v = std::round(v);
     return v > 0xFF ? 0xFF : (v < 0 ? 0 : (uint8_t)v);
 }
 
-// 混合颜色
+// 混合颜色, 整数精确计算后四舍五入; 背景和前景都完全透明时返回0
 // @bg 背景
 // @fg 前景
 // @mutiply 正片叠底
 inline color mix(color bg, color fg, bool mutiply)
 {
-    const auto ra = ca(bg) * ca(fg) / 255.0;
-    auto a = clamp(ca(bg)+ca(fg) - ra);
-
-    auto fx1 = [](color bv,color fv) -> double{
-        return bv;
+    const uint32_t ab = ca(bg), af = ca(fg);
+    const uint32_t wb = ab * (255 - af);    // 背景颜色的权重(*255)
+    const uint32_t wf = 255 * af;           // 前景颜色的权重(*255)
+    const uint32_t x = wb + wf;             // 结果alpha(*255)
+    if(x == 0)
+        return 0;
+    // n/d四舍五入
+    auto div = [](uint64_t n,uint64_t d) -> uint32_t {
+        const auto v = (2 * n + d) / (2 * d);
+        return v > 0xFF ? 0xFF : (uint32_t)v;
     };
-    auto fx2 = [](color bv,color fv) -> double{
-        return (bv+fv - (bv*fv) / 255.0);
+    auto fx = [&](uint32_t bv,uint32_t fv) -> uint32_t {
+        if(!mutiply)
+            return div(bv * wb + fv * wf,x);
+        // 两者重叠的部分取 bv*fv/255
+        return div(255ull * (bv * wb + fv * af * (255 - ab)) + (uint64_t)ab * af * bv * fv,255ull * x);
     };
+    return argb(div(x,255),fx(cr(bg),cr(fg)),fx(cg(bg),cg(fg)),fx(cb(bg),cb(fg)));
+}
 
-    std::function<double(color,color)> fx = fx1;
-    if(mutiply) fx = fx2;
+// 颜色预乘alpha, 四舍五入
+inline color premultiply(color c)
+{
+    const uint32_t a = ca(c);
+    auto fx = [a](uint32_t v) -> uint8_t { return uint8_t((2 * v * a + 255) / 510); };
+    return argb((uint8_t)a,fx(cr(c)),fx(cg(c)),fx(cb(c)));
+}
 
-    auto r = clamp((cr(bg)*ca(bg) + cr(fg)*ca(fg) - ra * fx(cr(bg),cr(fg))) / a);
-    auto g = clamp((cg(bg)*ca(bg) + cg(fg)*ca(fg) - ra * fx(cg(bg),cg(fg))) / a);
-    auto b = clamp((cb(bg)*ca(bg) + cb(fg)*ca(fg) - ra * fx(cb(bg),cb(fg))) / a);
-    return argb(a,r,g,b);
+// 预乘alpha的颜色还原, 四舍五入; alpha为0时返回0
+// 低alpha的颜色预乘后精度损失, 还原的颜色不一定与预乘前相同
+inline color unpremultiply(color c)
+{
+    const uint32_t a = ca(c);
+    if(a == 0)
+        return 0;
+    auto fx = [a](uint32_t v) -> uint8_t {
+        const auto r = (510 * v + a) / (2 * a);
+        return r > 0xFF ? 0xFF : (uint8_t)r;
+    };
+    return argb((uint8_t)a,fx(cr(c)),fx(cg(c)),fx(cb(c)));
 }
 
+// 连续内存的只读视图, 不持有内存
+template<typename T>
+struct Span
+{
+    using const_iterator = const T*;
+    using const_reverse_iterator = std::reverse_iterator<const T*>;
+
+    Span() = default;
+    Span(const T* ptr,size_t size) : _ptr(ptr),_size(size) {}
+    Span(const std::vector<T>& v) : _ptr(v.data()),_size(v.size()) {}
+
+    inline const T* data() const { return _ptr; }
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+    inline const T* begin() const { return _ptr; }
+    inline const T* end() const { return _ptr + _size; }
+    inline const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    inline const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    inline const T& front() const { return _ptr[0]; }
+    inline const T& back() const { return _ptr[_size - 1]; }
+    inline const T& operator[](size_t i) const { return _ptr[i]; }
+private:
+    const T* _ptr = nullptr;
+    size_t _size = 0;
+};
+
 struct Font
 {
+    // 颜色格式的标志互斥, 都没有设置时是24位色; 只在创建时设置,后续不可更改
+    // A8和A1只保存覆盖率, 读取的颜色是白色, alpha为覆盖率; 绘制时用混合颜色(正片叠底)着色
     enum Flag {
-        FL_BIT32    = 1     // 是否是32位色, 带有alpha通道(只在创建时设置,后续不可更改)
+        FL_BIT32    = 1,    // 是否是32位色, 带有alpha通道
+        FL_A8       = 2,    // 8位覆盖率
+        FL_A1       = 4,    // 1位覆盖率, 每行按字节对齐, 高位在前
+        FL_PAL4     = 8,    // 4位调色板索引, 每行按字节对齐, 高位在前
+        FL_PAL8     = 16,   // 8位调色板索引
+        FL_FORMAT   = FL_BIT32 | FL_A8 | FL_A1 | FL_PAL4 | FL_PAL8,
+        // 只对FL_BIT32有效: 图像数据保存为预乘alpha的颜色, 可以直接用BM_PREMUL混合或上传到预乘alpha的纹理
+        // 读取的颜色(get/getColor)仍是非预乘的; 只在创建时设置, 或用setPremultiplied转换
+        FL_PREMUL   = 32,
+        // 文件在调色板之后有字距调整表; 由字体按kernings()维护, setHeader不能更改
+        FL_KERNING  = 64,
+        // 只对调色板格式有效: 文件头的透明色有效, 颜色等于透明色的像素是透明的(由24位色转换而来); 只在创建时设置
+        // 没有时只按调色板颜色的alpha判断透明; 24位色总是使用透明色
+        FL_KEYED    = 128
     };
+    // 文件中的Header/Char与内存相同(宽布局); 旧版本的紧凑布局只读取, 读取时转换
+    // Header/Char的字段按自然对齐排列, 没有编译器填充, 文件中为小端; 字符表可以直接从映射内存使用
     struct Header
     {
         uint8_t lang[4];    // 语言标记
         uint8_t flag;       // 标志(备用)
-        uint16_t count;     // 字符数量
-        uint8_t lineHeight; // 字体行高
-        uint8_t maxWidth;   // 最大字符宽度
         uint8_t spacingX;   // 推荐水平间距
-        color transparent;  // 透明色值, 非32位色才有效
+        uint16_t lineHeight;// 字体行高
+        uint32_t count;     // 字符数量
+        uint16_t maxWidth;  // 最大字符宽度
+        uint16_t reserved;  // 保留, 为0
+        color transparent;  // 透明色值, 只有24位色和有FL_KEYED的调色板格式才有效
         uint8_t padding[4]; // 字符的内边距(left,top,right,bottom), 字体创建后就不能再更改
     };
 
@@ -102,16 +175,40 @@ struct Font
     {
         char32_t code = 0;      //字符的unicode码
         uint32_t pos = 0;       //字符颜色数据的地址(插入时自动计算)
-        uint8_t width = 0;		//字符宽度(包括水平内间距)
-        uint8_t height = 0;		//字符高度(包括垂直内间距)
-        uint8_t xadvance = 0;   //字符宽度(不包括水平间距)+字符间的固有间距
-        int8_t xoffset = 0;		//字符水平偏移
-        int8_t yoffset = 0;		//字符垂直偏移
+        uint16_t width = 0;		//字符宽度(包括水平内间距)
+        uint16_t height = 0;	//字符高度(包括垂直内间距)
+        uint16_t xadvance = 0;  //字符宽度(不包括水平间距)+字符间的固有间距
+        int16_t xoffset = 0;	//字符水平偏移
+        int16_t yoffset = 0;	//字符垂直偏移
+        uint16_t reserved = 0;  //保留, 为0
     };
     using CharList = std::vector<Char>;
+
+    // 字距调整: first之后紧跟second时, second向右移动amount(负数向左)
+    struct Kerning
+    {
+        char32_t first = 0;
+        char32_t second = 0;
+        int16_t amount = 0;
+        uint16_t reserved = 0;  //保留, 为0
+    };
+    using KerningList = std::vector<Kerning>;
+    using CharSpan = Span<Char>;
     using CharPtrList = std::vector<const Char*>;
+    // 像素在字符数据中的偏移, 单位由格式决定(A1是位, 其他是字节)
     using fn_offset = uint32_t(*)(uint16_t x,uint16_t y,uint16_t w);
-    using fn_to_color = color(*)(const uint8_t*);
+    // 读取字符数据中偏移处的颜色, 调色板格式从palette中取色
+    using fn_to_color = color(*)(const uint8_t*,uint32_t offset,const color* palette);
+
+    // copyTo输出的像素格式, 名称是内存中的字节顺序
+    enum PixelFormat {
+        PF_BGRA8,   // 4字节, 与小端的color(argb)相同
+        PF_RGBA8,   // 4字节
+        PF_A8,      // 1字节, 只有alpha
+        PF_RGB565,  // 2字节, 小端, 丢弃alpha
+        PF_BGRA8_PREMUL,    // 同PF_BGRA8, 颜色预乘alpha
+        PF_RGBA8_PREMUL     // 同PF_RGBA8, 颜色预乘alpha
+    };
 
     // 字符数据
     struct DataPtr;
@@ -120,8 +217,16 @@ struct Font
         Data();
         Data(const DataPtr&);
         Data(Data&&);
-        inline uint8_t w() const { return _w; }
-        inline uint8_t h() const { return _h; }
+        inline uint16_t w() const { return _w; }
+        inline uint16_t h() const { return _h; }
+        // 颜色格式(FL_BIT32/FL_A8/FL_A1/FL_PAL4/FL_PAL8), 0为24位色
+        inline uint8_t format() const { return _fmt; }
+        inline Span<color> palette() const { return _palette; }
+        // 原始数据的颜色是否预乘alpha(FL_BIT32|FL_PREMUL)
+        bool premultiplied() const;
+        // 是否有透明色: 24位色和有FL_KEYED的调色板格式; key是透明色的rgb
+        inline bool keyed() const { return _keyed; }
+        inline color key() const { return _key; }
 
         const uint8_t* ptr() const;
         color get(int x,int y) const;
@@ -130,7 +235,11 @@ struct Font
     private:
         friend struct Font;
         std::vector<uint8_t> _data;
-        uint8_t _w,_h;
+        std::vector<color> _palette;
+        uint16_t _w,_h;
+        uint8_t _fmt;
+        bool _keyed;
+        color _key;
         fn_offset offset;
         fn_to_color to_color;
     };
@@ -140,19 +249,41 @@ struct Font
     {
         DataPtr();
         DataPtr(Data&);
-        DataPtr(const Font* fnt,const uint8_t* ptr,uint8_t w,uint8_t h);
-        inline uint8_t w() const { return _w; }
-        inline uint8_t h() const { return _h; }
+        // pin持有ptr所在的内存(按需读取的缓存页), 为空时ptr由字体或Data保证有效
+        DataPtr(const Font* fnt,const uint8_t* ptr,uint16_t w,uint16_t h,std::shared_ptr<const void> pin = {});
+        inline uint16_t w() const { return _w; }
+        inline uint16_t h() const { return _h; }
+        // 颜色格式(FL_BIT32/FL_A8/FL_A1/FL_PAL4/FL_PAL8), 0为24位色
+        inline uint8_t format() const { return _fmt; }
+        inline Span<color> palette() const { return _palette; }
+        // 原始数据的颜色是否预乘alpha(FL_BIT32|FL_PREMUL)
+        bool premultiplied() const;
+        // 是否有透明色: 24位色和有FL_KEYED的调色板格式; key是透明色的rgb
+        inline bool keyed() const { return _keyed; }
+        inline color key() const { return _key; }
 
         const uint8_t* ptr() const;
         color get(int x,int y) const;
         bool valid() const;
+
+        // 每行的字节数, 每行按字节对齐
+        uint32_t stride() const;
+        // 第y行的原始数据, 长度为stride
+        Span<uint8_t> row(int y) const;
+        // 把整个字符转换为pf格式写入dst, dstStride是dst每行的字节数; 颜色与get的结果相同, 但透明色的alpha为0
+        // 预乘的数据输出为*_PREMUL格式时直接复制颜色, 没有精度损失
+        bool copyTo(void* dst,size_t dstStride,PixelFormat pf) const;
     private:
         friend struct Data;
         const uint8_t* _ptr;
-        uint8_t _w,_h;
+        Span<color> _palette;
+        uint16_t _w,_h;
+        uint8_t _fmt;
+        bool _keyed;
+        color _key;
         fn_offset offset;
         fn_to_color to_color;
+        std::shared_ptr<const void> _pin;
     };
 
     // 字体适配器, 用于从其他格式读取字体
@@ -162,15 +293,42 @@ struct Font
         Header& header();
         const CharList& charList() const;
         const std::vector<uint8_t>& data() const;
+        // 调色板格式(FL_PAL4/FL_PAL8)的颜色
+        const std::vector<color>& palette() const;
+        const KerningList& kernings() const;
     protected:
+        friend struct Font;
         Header _header;
         CharList _chrs;
         std::vector<uint8_t> _data;
+        std::vector<color> _palette;
+        KerningList _kernings;
+    };
+
+    // 字体文件的压缩方式, 保存在文件标签后的一个字节的低4位; 高4位是文件头和字符表的布局(Layout)
+    enum Compress {
+        CP_NONE     = 0,    // 不压缩
+        CP_LZ4      = 1,    // 文件头之后的全部内容压缩为一个LZ4帧
+        CP_BLOCK    = 2     // 字符表不压缩, 图像数据分成独立压缩的块, 可以单独解压某个字符(支持MD_MAP/MD_LAZY)
+    };
+
+    // 文件头和字符表的布局
+    enum Layout {
+        LO_COMPACT  = 0,    // 紧凑布局: 字符数16位, 行高/宽/高/步进8位, 偏移int8; 映射时字符表解码到内存
+        LO_WIDE     = 1     // 宽布局: 与内存中的Header/Char相同, 字符数32位, 尺寸16位, 偏移int16; 映射时直接引用字符表
+    };
+
+    // 字体文件的打开方式
+    enum Mode {
+        MD_COPY,    // 读取全部内容到内存
+        MD_MAP,     // 只读映射文件, 字符表和图像数据直接指向映射的内存(CP_BLOCK按需解压; CP_LZ4和旧版本紧凑布局的文件会退化为MD_COPY)
+        MD_LAZY     // 只读取字符表, 字符图像数据在第一次使用时从文件读取并缓存(CP_LZ4会退化为MD_COPY)
     };
 
     Font();
 
     const Char& c(char32_t chr) const;
+    // 获取字符串对应的字符列表, char按UTF-8解码, wchar_t按UTF-16(2字节时)或UTF-32解码
     CharPtrList cs(const char* str) const;
     CharPtrList cs(const wchar_t* str) const;
     CharPtrList cs(const char32_t* str) const;
@@ -178,14 +336,33 @@ struct Font
     CharPtrList css(const std::wstring& str) const;
     CharPtrList css(const std::u32string& str) const;
 
+    // 获取字符串对应的字符列表, 写入out并返回字符数; 复用out的容量, 容量足够时不分配内存
+    size_t cs(std::string_view str,CharPtrList& out) const;
+    size_t cs(std::wstring_view str,CharPtrList& out) const;
+    size_t cs(std::u32string_view str,CharPtrList& out) const;
+    // 获取字符串对应的字符列表, 写入长度为capacity的缓冲区, 超出的部分被丢弃; 返回写入的字符数
+    size_t cs(std::string_view str,const Char** out,size_t capacity) const;
+    size_t cs(std::wstring_view str,const Char** out,size_t capacity) const;
+    size_t cs(std::u32string_view str,const Char** out,size_t capacity) const;
+
     const Header& header() const;
     void setHeader(const Header& header);
 
+    // 设置字符查找时直接寻址的码段(默认0~0x2FF), 例如加入常用的CJK码段{0x4E00,0x9FFF}
+    void setDirectRanges(const CharIndex::Ranges& ranges);
+    const CharIndex::Ranges& directRanges() const;
+
     // 返回字符列表
-    const CharList& chrs() const;
+    CharSpan chrs() const;
+
+    // 获取总图像数据, MD_LAZY打开的字体返回空
+    Span<uint8_t> data() const;
 
-    // 获取总图像数据
-    const std::vector<uint8_t>& data() const;
+    // 调色板, 非调色板格式返回空; 长度总是16(FL_PAL4)或256(FL_PAL8), 未使用的颜色为0
+    Span<color> palette() const;
+
+    // 设置按需读取的字符图像数据的缓存容量(字节), 用于MD_LAZY以及MD_MAP打开的CP_BLOCK文件(按块解压后缓存)
+    void setCacheSize(size_t bytes);
 
     // 获取字符像素颜色
     color getColor(const Char& ch,int x,int y) const;
@@ -196,43 +373,136 @@ struct Font
                   ) const;
 
     // 获取字符图像数据的指针访问对象
+    // MD_LAZY打开的字体和MD_MAP打开的CP_BLOCK文件按需读取/解压, 超过缓存容量时淘汰最久未使用的数据
+    // 此时返回的对象持有所在的缓存页, 缓存页被淘汰后仍然有效(直到对象析构才释放内存); 可以在多线程中同时调用
+    // 其他情况返回的对象直接指向字体的数据, 在字体修改/清除/析构之前有效
     DataPtr getData(const Char& ch) const;
 
     // 获取字符的图像数据
     bool getData(const Char& ch,Data& out) const;
 
+    // 32位色字体的图像数据是否预乘alpha
+    bool premultiplied() const;
+    // 把32位色字体的图像数据转换为预乘/非预乘alpha, 之后保存的文件也是转换后的; 其他格式返回false
+    bool setPremultiplied(bool on);
+
+    // 字距调整表, 按(first,second)排序
+    Span<Kerning> kernings() const;
+    // 设置字距调整表; 同一字符对保留最后一个, amount为0或字符码超出Unicode的忽略
+    void setKernings(KerningList list);
+    // 字符对的字距调整, 没有时返回0; 查找开放寻址的哈希表, 没有字距调整表的字体只判断一次
+    int kerning(char32_t first,char32_t second) const;
 
-    // 插入字符
+
+    // 插入字符, 已存在则替换; 均摊O(1)
+    // 数据的格式与字体不同时按颜色转换; 调色板放不下新的颜色时先把字体转换为FL_PAL8, 或者24位色(FL_KEYED)/32位色
+    // 字符列表的顺序和字符引用在插入/删除后都可能改变
     bool insert(const Char& ch,const Data& data);
-    // 删除字符
+    // 删除字符, 用最后一个字符填补空位, 数据块没有其他字符共用时只标记为作废; 均摊O(1)
     void remove(char32_t ch);
+    // 批量编辑, beginEdit/endEdit之间不自动整理数据, 可以嵌套
+    void beginEdit();
+    void endEdit();
+    // 回收作废的数据块, 共用的数据块仍然共用
+    void compact();
+    // 裁剪每个字符四周透明的像素, 裁掉的左/上边计入xoffset/yoffset, 绘制和排版的结果不变
+    // 透明: alpha为0, 或24位色/有FL_KEYED的调色板格式等于文件头的透明色
+    // 完全透明的字符(如空格)不裁剪; xoffset/yoffset超出int16范围的部分不裁剪; 返回减少的数据字节数
+    size_t trim();
     // 清除所有字符
     void clear();
 
     // 读取字体文件
-    bool open(const std::string& filename);
-    // 保存字体文件
+    // @mode 打开方式, MD_MAP时字体只读, 插入/删除字符会先把数据复制到内存
+    bool open(const std::string& filename,Mode mode = MD_COPY);
+    // 保存字体文件, compress为true时使用CP_BLOCK
+    // layout为LO_COMPACT时, 所有数值都在紧凑布局的范围内才使用紧凑布局, 否则使用宽布局;
+    // 指定LO_WIDE时总是使用宽布局, 字符表可以直接映射(MD_MAP)而不复制
+    // 保存前合并内容相同的字符数据(宽高相同), 多个字符共用一个数据块
+    // 24/32位色的字体颜色数不超过256时自动保存为调色板格式(FL_PAL4/FL_PAL8), 读取的颜色不变; FL_PREMUL的字体除外
+    // 32位色的透明度保存在调色板颜色的alpha中; 24位色保留文件头的透明色, 并设置FL_KEYED
     bool save(const std::string& filename,bool compress = false);
-    // 从适配器读取字体
+    bool save(const std::string& filename,Compress compress,Layout layout = LO_COMPACT);
+    // 从适配器读取字体, 适配器的32位色数据是非预乘的, 文件头有FL_PREMUL时读取后转换为预乘
     bool load(const Adapter&);
-    // 从输入流读取字体
+    // 从适配器读取字体, 字符表/图像数据/调色板直接移入字体, 不复制; 之后适配器为空
+    bool load(Adapter&&);
+    // 从输入流读取字体, 只向前读取, 可以是管道等不可定位的流
     bool load(std::istream& si);
     // 从内存读取字体
     bool load(const uint8_t* data,uint32_t size);
+    // 从内存读取字体, mode为MD_MAP/MD_LAZY时字符表和图像数据直接引用data, 不复制(同MD_MAP打开文件)
+    // data在字体(以及复制出的字体)clear/重新读取/析构之前必须有效且不被修改; 插入/删除字符后字体复制数据, 不再引用data
+    // data需要4字节对齐, 否则或者CP_LZ4的数据仍然复制到内存
+    bool load(const uint8_t* data,uint32_t size,Mode mode);
+    // 设置分块压缩/解压使用的线程数, 0表示使用硬件线程数; 输出的文件与线程数无关
+    static void setThreads(unsigned n);
+
     // 当前字体是否有效
     bool valid() const;
+    // 字体是否直接引用映射的文件或外部内存
+    bool mapped() const;
+    // 字体的图像数据是否按需读取(MD_LAZY, 或MD_MAP打开的CP_BLOCK文件)
+    bool paged() const;
 private:
+    struct Mapping;
+    struct Pager;
+    // 映射字体文件
+    bool map(const std::string& filename);
+    // 直接引用映射的内存
+    bool map(std::shared_ptr<const Mapping> mapping);
+    // 打开字体文件, 图像数据按需读取
+    bool page(const std::string& filename);
+    // 根据文件头设置像素访问方式, 建立索引
+    void prepare();
+    // 字符图像数据的起始地址, 越界返回nullptr; 按需读取时pin持有所在的缓存页
+    const uint8_t* block(const Char& ch,std::shared_ptr<const void>& pin) const;
+    // 把映射的数据复制到内存, 之后可以修改
+    void detach();
+    // 作废的数据过多时整理
+    void shrink();
+    // 合并内容和宽高都相同的字符数据块
+    void dedup();
+    // 按颜色把其他格式的字符数据转换为字体的格式, 调色板格式会加入新的颜色; 调色板已满时失败
+    bool encode(const Data& data,std::vector<uint8_t>& out);
+    // 调色板放不下data的颜色时转换字体的格式: FL_PAL4够用时转换为FL_PAL8,
+    // 否则有FL_KEYED的转换为24位色, 其他转换为32位色; 读取的颜色不变
+    bool promote(const Data& data);
+    // 检查从适配器取得的文件头/字符表/图像数据/调色板, 建立索引
+    bool adopt();
+    // 整理字距调整表, 建立哈希表, 同步FL_KERNING
+    void index_kernings();
+    // 按字符表统计共用的数据块的引用数
+    void count_refs();
+    // 释放一个字符对数据块的引用, 返回数据块是否已经没有其他字符引用
+    bool unref(uint32_t pos);
+
     template<typename Rd>
-    friend bool load(Font&,Rd&);
+    friend bool load(Font&,Rd&,uint64_t);
     friend struct DataPtr;
 
     fn_offset offset;
     fn_to_color to_color;
 
     Header _header;
-    std::unordered_map<char32_t,Char*> _map;
+    std::vector<color> _palette;    // 补齐到palette_size
+    uint32_t _colors = 0;           // 调色板中使用的颜色数
+    CharIndex _index;   // 字符码 -> 字符列表下标
+    KerningList _kernings;
+    std::vector<uint64_t> _kerningHash;    // (first<<21|second)<<16|amount, 0为空位; 大小是2的幂
     CharList _chrs;
     std::vector<uint8_t> _data;
+    size_t _garbage = 0;    // _data中作废的字节数
+    // 多个字符共用的数据块: 地址 -> 引用数, 只记录引用数大于1的; 共用的块替换字符时不能原地覆盖
+    // 读取后在第一次编辑时(detach)统计, 之后由插入/删除/整理/合并维护
+    std::unordered_map<uint32_t,uint32_t> _refs;
+    bool _counted = false;  // _refs是否已统计
+    int _editing = 0;       // beginEdit的嵌套层数
+    std::shared_ptr<Pager> _pager;  // 不为空时图像数据按需读取
+    size_t _cacheSize = 4 << 20;
+    std::shared_ptr<const Mapping> _mapping;   // 不为空时_vchrs和_vdata指向映射内存
+    CharSpan _vchrs;
+    Span<uint8_t> _vdata;
     Char _sp;   // 缺省空格字符
 };
 
@@ -1,4 +1,5 @@
 #include "font_texture.h"
+#include "utf.h"
 #include <algorithm>
 
 namespace ck
@@ -41,20 +42,43 @@ static constexpr FontTexture::Char LT { '\t' };
 static constexpr FontTexture::Char L0 { '\0' };
 static constexpr FontTexture::Char LN { '\n' };
 
+// 解码字符串并查找字符, char按UTF-8, wchar_t按UTF-16/UTF-32; 返回写入out的字符数
 template<typename C>
-inline FontTexture::CharPtrList __cs(const FontTexture &f,const C* str)
+inline size_t __cs(const FontTexture &f,const C* str,size_t len,const FontTexture::Char** out,size_t capacity)
+{
+    size_t n = 0;
+    utf::decode(str,len,[&](char32_t ch){
+        if(n < capacity)
+            out[n++] = &f.c(ch);
+    });
+    return n;
+}
+
+template<typename C>
+inline size_t __cs(const FontTexture &f,const C* str,size_t len,FontTexture::CharPtrList& out)
+{
+    out.resize(len);    // 码点数不会超过编码单元数
+    const auto n = __cs<C>(f,str,len,out.data(),len);
+    out.resize(n);
+    return n;
+}
+
+template<typename C>
+inline FontTexture::CharPtrList __cs(const FontTexture &f,const C* str,size_t len)
 {
     if (!str) return {};
-    const auto len = std::char_traits<C>::length(str);
     FontTexture::CharPtrList ret;
-    ret.resize(len);
-    for(int i=0;i<(int)len;++i)
-    {
-        ret[i] = &f.c(str[i]);
-    }
+    __cs<C>(f,str,len,ret);
     return ret;
 }
 
+template<typename C>
+inline FontTexture::CharPtrList __cs(const FontTexture &f,const C* str)
+{
+    if (!str) return {};
+    return __cs<C>(f,str,std::char_traits<C>::length(str));
+}
+
 FontTexture::FontTexture()
 {}
 
@@ -66,12 +90,12 @@ const FontTexture::Char &FontTexture::c(char32_t c) const
         return LN;
     if (c == '\t')
         return LT;
-    auto iter = _map.find(c);
-    if(iter == _map.end())
+    const auto i = _index.find(c);
+    if(i == CharIndex::npos)
     {
         return _chrs.front();
     }
-    return *iter->second;
+    return _chrs[i];
 }
 
 FontTexture::CharPtrList FontTexture::cs(const char *str) const
@@ -91,17 +115,47 @@ FontTexture::CharPtrList FontTexture::cs(const char32_t *str) const
 
 FontTexture::CharPtrList FontTexture::css(const std::string &str) const
 {
-     return __cs<char>(*this,str.c_str());
+    return __cs<char>(*this,str.data(),str.size());
 }
 
 FontTexture::CharPtrList FontTexture::css(const std::wstring &str) const
 {
-    return __cs<wchar_t>(*this,str.c_str());
+    return __cs<wchar_t>(*this,str.data(),str.size());
 }
 
 FontTexture::CharPtrList FontTexture::css(const std::u32string &str) const
 {
-    return __cs<char32_t>(*this,str.c_str());
+    return __cs<char32_t>(*this,str.data(),str.size());
+}
+
+size_t FontTexture::cs(std::string_view str, CharPtrList &out) const
+{
+    return __cs<char>(*this,str.data(),str.size(),out);
+}
+
+size_t FontTexture::cs(std::wstring_view str, CharPtrList &out) const
+{
+    return __cs<wchar_t>(*this,str.data(),str.size(),out);
+}
+
+size_t FontTexture::cs(std::u32string_view str, CharPtrList &out) const
+{
+    return __cs<char32_t>(*this,str.data(),str.size(),out);
+}
+
+size_t FontTexture::cs(std::string_view str, const Char **out, size_t capacity) const
+{
+    return __cs<char>(*this,str.data(),str.size(),out,capacity);
+}
+
+size_t FontTexture::cs(std::wstring_view str, const Char **out, size_t capacity) const
+{
+    return __cs<wchar_t>(*this,str.data(),str.size(),out,capacity);
+}
+
+size_t FontTexture::cs(std::u32string_view str, const Char **out, size_t capacity) const
+{
+    return __cs<char32_t>(*this,str.data(),str.size(),out,capacity);
 }
 
 const FontTexture::CharList &FontTexture::chrs() const
@@ -116,7 +170,7 @@ const std::vector<void *> &FontTexture::pages() const
 
 void FontTexture::clear()
 {
-    _map.clear();
+    _index.clear();
     _chrs.clear();
     _pages.clear();
 }
@@ -331,11 +385,8 @@ bool FontTextureCreator::start(
     if(!out._chrs.empty() && texture)    // 最后一页
         out._pages.push_back(texture);
 
-    out._map.clear();
-    for(auto& c : out._chrs)
-    {
-        out._map[c.code] = &c;
-    }
+    out._index.setDirect(fnt.directRanges());
+    out._index.build(out._chrs.data(),out._chrs.size());
 
     return !out._chrs.empty();
 }
@@ -21,6 +21,7 @@ public:
     FontTexture();
 
     const Char& c(char32_t chr) const;
+    // 获取字符串对应的字符列表, char按UTF-8解码, wchar_t按UTF-16(2字节时)或UTF-32解码
     CharPtrList cs(const char* str) const;
     CharPtrList cs(const wchar_t* str) const;
     CharPtrList cs(const char32_t* str) const;
@@ -28,12 +29,21 @@ public:
     CharPtrList css(const std::wstring& str) const;
     CharPtrList css(const std::u32string& str) const;
 
+    // 获取字符串对应的字符列表, 写入out并返回字符数; 复用out的容量, 容量足够时不分配内存
+    size_t cs(std::string_view str,CharPtrList& out) const;
+    size_t cs(std::wstring_view str,CharPtrList& out) const;
+    size_t cs(std::u32string_view str,CharPtrList& out) const;
+    // 获取字符串对应的字符列表, 写入长度为capacity的缓冲区, 超出的部分被丢弃; 返回写入的字符数
+    size_t cs(std::string_view str,const Char** out,size_t capacity) const;
+    size_t cs(std::wstring_view str,const Char** out,size_t capacity) const;
+    size_t cs(std::u32string_view str,const Char** out,size_t capacity) const;
+
     const CharList& chrs() const;
     const std::vector<void*>& pages() const;
 
     void clear();
 private:
-    std::map<char32_t,Char*> _map;
+    CharIndex _index;   // 字符码 -> 字符列表下标
     CharList _chrs;
     std::vector<void*> _pages;
     friend class FontTextureCreator;
@@ -75,6 +85,7 @@ public:
     // 请求创建新纹理
     virtual void* newTexture() = 0;
 
+    // 把字符写入纹理; 预乘alpha的纹理可以用d.copyTo(..., Font::PF_RGBA8_PREMUL)直接写入
     virtual void perchar(const Font& fnt,const Char&, const Font::DataPtr &d, void* texture) = 0;
 protected:
     uint32_t _width, _height;
@@ -0,0 +1,167 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	glyph_view.h
+@brief 	format specialized glyph view header
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_GLYPH_VIEW_H
+#define CK_GLYPH_VIEW_H
+
+#include "font.h"
+
+namespace ck
+{
+
+// 字符图像数据的像素格式, 每种格式在编译期确定取色方式
+// row是某一行的起始地址, 每行按字节对齐
+namespace fmt
+{
+
+struct RGB24
+{
+    static constexpr int flag = 0;
+    static constexpr int bit = 24;
+    static inline color get(const uint8_t* row,int x,const color*)
+    { row += x * 3; return rgb(row[0],row[1],row[2]); }
+};
+
+struct ARGB32
+{
+    static constexpr int flag = Font::FL_BIT32;
+    static constexpr int bit = 32;
+    static inline color get(const uint8_t* row,int x,const color*)
+    { row += x * 4; return argb(row[0],row[1],row[2],row[3]); }
+};
+
+// 预乘alpha的32位色, 读取时还原为非预乘的颜色
+struct PARGB32
+{
+    static constexpr int flag = Font::FL_BIT32 | Font::FL_PREMUL;
+    static constexpr int bit = 32;
+    static inline color get(const uint8_t* row,int x,const color*)
+    { row += x * 4; return unpremultiply(argb(row[0],row[1],row[2],row[3])); }
+};
+
+struct A8
+{
+    static constexpr int flag = Font::FL_A8;
+    static constexpr int bit = 8;
+    static inline color get(const uint8_t* row,int x,const color*)
+    { return argb(row[x],0xff,0xff,0xff); }
+};
+
+struct A1
+{
+    static constexpr int flag = Font::FL_A1;
+    static constexpr int bit = 1;
+    static inline color get(const uint8_t* row,int x,const color*)
+    { return (row[x >> 3] >> (7 - (x & 7))) & 1 ? 0xffffffff : 0x00ffffff; }
+};
+
+struct PAL4
+{
+    static constexpr int flag = Font::FL_PAL4;
+    static constexpr int bit = 4;
+    static inline color get(const uint8_t* row,int x,const color* palette)
+    { return palette[(row[x >> 1] >> (x & 1 ? 0 : 4)) & 0xf]; }
+};
+
+struct PAL8
+{
+    static constexpr int flag = Font::FL_PAL8;
+    static constexpr int bit = 8;
+    static inline color get(const uint8_t* row,int x,const color* palette)
+    { return palette[row[x]]; }
+};
+
+}
+
+// 特定格式的字符图像视图, 不持有内存; 像素访问全部内联, 没有函数指针
+template<typename Fmt>
+struct GlyphView
+{
+    using format = Fmt;
+
+    GlyphView() = default;
+    GlyphView(const uint8_t* ptr,const color* palette,uint16_t w,uint16_t h)
+        : _ptr(ptr),_palette(palette),_stride((w * Fmt::bit + 7) / 8),_w(w),_h(h)
+    {}
+
+    inline uint16_t w() const { return _w; }
+    inline uint16_t h() const { return _h; }
+    // 每行的字节数
+    inline uint32_t stride() const { return _stride; }
+    inline const uint8_t* ptr() const { return _ptr; }
+    inline const color* palette() const { return _palette; }
+
+    // 第y行的起始地址
+    inline const uint8_t* row(int y) const
+    { return _ptr + (size_t)y * _stride; }
+
+    inline color get(int x,int y) const
+    { return Fmt::get(row(y),x,_palette); }
+
+    // 逐行遍历所有像素, 调用fn(x,y,color)
+    template<typename Fn>
+    inline void each(Fn&& fn) const
+    {
+        for(int y=0; y<_h; ++y)
+        {
+            const auto r = row(y);
+            for(int x=0; x<_w; ++x)
+                fn(x,y,Fmt::get(r,x,_palette));
+        }
+    }
+private:
+    const uint8_t* _ptr = nullptr;
+    const color* _palette = nullptr;
+    uint32_t _stride = 0;
+    uint16_t _w = 0, _h = 0;
+};
+
+// 按字符数据的格式调用一次fn(GlyphView<Fmt>), fn一般是泛型lambda, 每种格式各实例化一次
+// format是Fmt::flag, 预乘alpha的32位色是FL_BIT32|FL_PREMUL; 数据无效时不调用fn, 返回false
+template<typename Fn>
+inline bool visit(const uint8_t* ptr,Span<color> palette,uint16_t w,uint16_t h,int format,Fn&& fn)
+{
+    if(ptr == nullptr || w == 0 || h == 0)
+        return false;
+    switch (format) {
+    case Font::FL_A1: fn(GlyphView<fmt::A1>(ptr,palette.data(),w,h)); break;
+    case Font::FL_A8: fn(GlyphView<fmt::A8>(ptr,palette.data(),w,h)); break;
+    case Font::FL_PAL4: fn(GlyphView<fmt::PAL4>(ptr,palette.data(),w,h)); break;
+    case Font::FL_PAL8: fn(GlyphView<fmt::PAL8>(ptr,palette.data(),w,h)); break;
+    case Font::FL_BIT32: fn(GlyphView<fmt::ARGB32>(ptr,palette.data(),w,h)); break;
+    case Font::FL_BIT32 | Font::FL_PREMUL: fn(GlyphView<fmt::PARGB32>(ptr,palette.data(),w,h)); break;
+    default: fn(GlyphView<fmt::RGB24>(ptr,palette.data(),w,h)); break;
+    }
+    return true;
+}
+
+template<typename Fn>
+inline bool visit(const Font::DataPtr& d,Fn&& fn)
+{
+    if(!d.valid())
+        return false;
+    return visit(d.ptr(),d.palette(),d.w(),d.h(),d.format() | (d.premultiplied() ? Font::FL_PREMUL : 0),fn);
+}
+
+template<typename Fn>
+inline bool visit(const Font::Data& d,Fn&& fn)
+{
+    if(!d.valid())
+        return false;
+    return visit(d.ptr(),d.palette(),d.w(),d.h(),d.format() | (d.premultiplied() ? Font::FL_PREMUL : 0),fn);
+}
+
+}
+
+#endif // CK_GLYPH_VIEW_H
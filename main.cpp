@@ -31,19 +31,66 @@
 
 #include "font.h"
 #include "fnt_adapter.h"
+#include "test.h"
+#include <cstring>
 
-int main()
+// test_ckfont [用例]: 运行测试用例(不指定时运行全部), 通过时返回0
+// test_ckfont <基准>: 运行基准, 输出耗时
+// test_ckfont fnt <输入.fnt> <输出.ckf>: 转换BMFont字体
+int main(int argc,char** argv)
 {
-    ck::Font fnt;
-    fnt.load("./test1.fnt");
+    if(argc >= 4 && strcmp(argv[1],"fnt") == 0)
+    {
+        ck::FntAdapter adp;
+        if(!adp.load(argv[2],0))
+            return 1;
+        ck::Font fnt;
+        if(!fnt.load(std::move(adp)))
+            return 1;
+        return fnt.save(argv[3]) ? 0 : 1;
+    }
 
-    ck::FntAdapter adp;
-    adp.load("E:/Tools/BMFont/test1.fnt",0);
+    // 先于其他用例调用simd(), 只在指定时运行
+    if(argc > 1 && strcmp(argv[1],"simd_env") == 0)
+        return ck::test::simdEnv() ? 0 : 1;
 
-    ck::Font fnt1;
-    fnt1.load(adp);
-
-    fnt1.save("./test1.fnt");
-
-    return 0;
+    const struct { const char* name; bool(*run)(); } cases[] = {
+        { "blend",ck::test::blend },
+        { "blend_exhaustive",ck::test::blendExhaustive },
+        { "convert",ck::test::convert },
+        { "dispatch",ck::test::dispatch },
+        { "keyed",ck::test::keyed },
+        { "kerning",ck::test::kerning },
+        { "layout",ck::test::layout },
+        { "roundtrip",ck::test::roundtrip },
+        { "dedup",ck::test::dedup },
+        { "trim",ck::test::trim },
+        { "blocks",ck::test::blocks },
+    };
+    const struct { const char* name; bool(*run)(); } benches[] = {
+        { "bench_index",ck::test::benchIndex },
+        { "bench_blocks",ck::test::benchBlocks },
+        { "bench_kerning",ck::test::benchKerning },
+    };
+    for(auto& it : benches)
+    {
+        if(argc > 1 && strcmp(argv[1],it.name) == 0)
+            return it.run() ? 0 : 1;
+    }
+    int failed = 0, ran = 0;
+    for(auto& it : cases)
+    {
+        if(argc > 1 && strcmp(argv[1],it.name) != 0)
+            continue;
+        ++ran;
+        const bool ok = it.run();
+        std::cout << (ok ? "[PASS] " : "[FAIL] ") << it.name << std::endl;
+        failed += ok ? 0 : 1;
+    }
+    if(ran == 0)
+    {
+        std::cerr << "unknown test case: " << argv[1] << std::endl;
+        return 1;
+    }
+    return failed == 0 ? 0 : 1;
 }
@@ -0,0 +1,69 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	test.h
+@brief 	test_ckfont test cases header
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_TEST_H
+#define CK_TEST_H
+
+#include <iostream>
+
+// 只在ENABLE_TEST_CKFONT时编译; 每个用例返回是否通过, 失败时输出位置
+#define CK_CHECK(x) do { \
+    if(!(x)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << " check failed: " << #x << std::endl; \
+        return false; \
+    } \
+} while(0)
+
+namespace ck
+{
+namespace test
+{
+
+// 每个支持的指令集(setSimd)的批量混合与逐像素混合结果相同
+bool blend();
+// 同上, 穷举每种混合方式的前景alpha/背景通道/前景通道的所有组合
+bool blendExhaustive();
+// 每个支持的指令集的行转换(premultiply/swapRedBlue/unpackArgb)与逐像素转换结果相同
+bool convert();
+// setSimd指定每个指令集: 支持时使用指定的, 否则使用simdDetect(), 并按实际的指令集混合
+bool dispatch();
+// 环境变量CKFONT_SIMD决定第一次simd()的结果, 按它选择的内核混合; 需要在调用setSimd之前单独运行
+bool simdEnv();
+// 24位色和有FL_KEYED的调色板格式: copyTo/blend把透明色的像素作为透明
+bool keyed();
+// 字距调整: kerning()的查找, setKernings的去重(保留最后一个), 绘制的位置和保存/读取
+bool kerning();
+// 保存时数值都在范围内的字体使用紧凑布局, 否则使用宽布局; 两种布局都可以按各种方式打开
+bool layout();
+// 保存后按各种方式读取(MD_COPY/MD_MAP/MD_LAZY, 内存, 流), CP_NONE和CP_BLOCK的像素都不变
+bool roundtrip();
+// 保存时合并内容相同的数据块, 替换/删除共用的字符不影响其他字符, compact只回收不再使用的块
+bool dedup();
+// trim后measure的结果和绘制的像素不变
+bool trim();
+// 截断或大小溢出的块索引(CP_BLOCK)被所有读取方式拒绝
+bool blocks();
+
+// 基准, 输出耗时, 只在指定时运行
+// CharIndex与std::unordered_map的查找耗时, 并检查两者结果相同
+bool benchIndex();
+// CP_BLOCK保存/读取的耗时随线程数(1,2,4..硬件线程数)的变化, 并检查输出与线程数无关
+bool benchBlocks();
+// 有/没有字距调整表时measure和draw的耗时, 并检查单行的宽度只差字距调整的总和
+bool benchKerning();
+
+}
+}
+
+#endif // CK_TEST_H
@@ -0,0 +1,262 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	test_blend.cpp
+@brief 	blend kernel test source
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#include "test.h"
+#include "blend.h"
+#include "cpu.h"
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace ck
+{
+namespace test
+{
+
+// 背景的alpha分布
+enum Background {
+    BG_OPAQUE,      // 全部不透明, BM_MULTIPLY也使用SIMD
+    BG_TRANSLUCENT, // 全部半透明(含完全透明)
+    BG_MIXED        // 混合, 同一批像素中有的不透明有的半透明
+};
+
+// 随机颜色, 边界值(0/255)的概率较高
+static color random_color(std::mt19937& rng,int alpha)
+{
+    auto channel = [&rng]() -> uint32_t {
+        const auto v = rng() % 260;
+        return v < 256 ? v : (v & 1) * 255;
+    };
+    const uint32_t a = alpha >= 0 ? (uint32_t)alpha : channel();
+    return a << 24 | channel() << 16 | channel() << 8 | channel();
+}
+
+static bool blend_level(Simd level)
+{
+    const BlendMode modes[] = { BM_NORMAL,BM_MULTIPLY,BM_ADD,BM_PREMUL };
+    std::mt19937 rng(404);
+    std::vector<color> bg,fg,dst;
+    // 长度覆盖空输入和不是向量宽度(4/8)整数倍的尾部
+    for(size_t n=0; n<=67; ++n)
+    {
+        for(auto mode : modes)
+        {
+            for(auto kind : { BG_OPAQUE,BG_TRANSLUCENT,BG_MIXED })
+            {
+                bg.resize(n);
+                fg.resize(n);
+                for(size_t i=0; i<n; ++i)
+                {
+                    int alpha = -1;
+                    if(kind == BG_OPAQUE || (kind == BG_MIXED && rng() % 2))
+                        alpha = 255;
+                    else if(kind == BG_TRANSLUCENT)
+                        alpha = rng() % 255;
+                    bg[i] = random_color(rng,alpha);
+                    fg[i] = random_color(rng,-1);
+                    // 预乘的颜色不大于alpha
+                    if(mode == BM_PREMUL)
+                    {
+                        const auto a = ca(fg[i]);
+                        fg[i] = argb(a,cr(fg[i]) * a / 255,cg(fg[i]) * a / 255,cb(fg[i]) * a / 255);
+                    }
+                }
+                dst = bg;
+                blend(dst.data(),fg.data(),n,mode);
+                for(size_t i=0; i<n; ++i)
+                {
+                    const auto expected = blend(bg[i],fg[i],mode);
+                    if(dst[i] != expected)
+                    {
+                        std::cerr << "simd " << level << " mode " << mode << " n " << n << " i " << i << std::hex
+                                  << ": bg " << bg[i] << " fg " << fg[i]
+                                  << " got " << dst[i] << " expected " << expected << std::dec << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool blend()
+{
+    const auto saved = simd();
+    bool ok = true;
+    for(auto level : { SIMD_NONE,SIMD_SSE2,SIMD_AVX2,SIMD_NEON })
+    {
+        if(!simdSupported(level))
+            continue;
+        CK_CHECK(setSimd(level) == level);
+        std::cout << "blend: simd " << level << std::endl;
+        ok = blend_level(level) && ok;
+    }
+    setSimd(saved);
+    return ok;
+}
+
+// 穷举: 前景alpha(256) x 背景通道(256) x 前景通道(256), 每个组合在红色通道中出现一次
+// 背景alpha随像素变化, 覆盖所有的(背景alpha,前景alpha); BM_MULTIPLY的背景不透明才使用SIMD
+static bool exhaustive_level(Simd level)
+{
+    const BlendMode modes[] = { BM_NORMAL,BM_MULTIPLY,BM_ADD,BM_PREMUL };
+    std::vector<color> bg(256 * 256),fg(bg.size()),dst;
+    for(auto mode : modes)
+    {
+        for(uint32_t af=0; af<256; ++af)
+        {
+            for(uint32_t i=0; i<bg.size(); ++i)
+            {
+                const uint32_t bv = i & 0xff, fv = i >> 8;
+                const uint32_t ab = mode == BM_MULTIPLY ? 255 : (bv + fv * 3 + af * 7) & 0xff;
+                // 绿色/蓝色通道是其他的组合
+                bg[i] = argb(ab,bv,255 - bv,fv ^ af);
+                fg[i] = argb(af,fv,(fv * 5 + bv) & 0xff,255 - fv);
+            }
+            dst = bg;
+            blend(dst.data(),fg.data(),dst.size(),mode);
+            for(size_t i=0; i<dst.size(); ++i)
+            {
+                const auto expected = blend(bg[i],fg[i],mode);
+                if(dst[i] != expected)
+                {
+                    std::cerr << "simd " << level << " mode " << mode << std::hex
+                              << ": bg " << bg[i] << " fg " << fg[i]
+                              << " got " << dst[i] << " expected " << expected << std::dec << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool blendExhaustive()
+{
+    const auto saved = simd();
+    bool ok = true;
+    for(auto level : { SIMD_SSE2,SIMD_AVX2,SIMD_NEON })
+    {
+        if(!simdSupported(level))
+            continue;
+        CK_CHECK(setSimd(level) == level);
+        std::cout << "blend_exhaustive: simd " << level << std::endl;
+        ok = exhaustive_level(level) && ok;
+    }
+    setSimd(saved);
+    return ok;
+}
+
+static bool convert_level(Simd level)
+{
+    // premultiply: 所有的(alpha,通道)组合, 其他通道是别的组合
+    std::vector<color> src(256 * 256),dst;
+    for(uint32_t i=0; i<src.size(); ++i)
+        src[i] = argb(i >> 8,i & 0xff,255 - (i & 0xff),(i * 7) & 0xff);
+    dst = src;
+    premultiply(dst.data(),dst.size());
+    for(size_t i=0; i<src.size(); ++i)
+    {
+        if(dst[i] != premultiply(src[i]))
+        {
+            std::cerr << "simd " << level << " premultiply " << std::hex << src[i]
+                      << " got " << dst[i] << " expected " << premultiply(src[i]) << std::dec << std::endl;
+            return false;
+        }
+    }
+    // 长度覆盖不是向量宽度整数倍的尾部, 字节数据从不对齐的地址开始
+    std::mt19937 rng(404);
+    std::vector<uint8_t> bytes;
+    for(size_t n=0; n<=67; ++n)
+    {
+        src.resize(n);
+        for(auto& it : src)
+            it = random_color(rng,-1);
+        dst = src;
+        swapRedBlue(dst.data(),n);
+        for(size_t i=0; i<n; ++i)
+            CK_CHECK(dst[i] == argb(ca(src[i]),cb(src[i]),cg(src[i]),cr(src[i])));
+        bytes.assign(n * 4 + 1,0);
+        for(size_t i=0; i<n; ++i)
+        {
+            const auto p = bytes.data() + 1 + i * 4;
+            p[0] = ca(src[i]);
+            p[1] = cr(src[i]);
+            p[2] = cg(src[i]);
+            p[3] = cb(src[i]);
+        }
+        dst.assign(n,0);
+        unpackArgb(bytes.data() + 1,dst.data(),n);
+        CK_CHECK(dst == src);
+    }
+    return true;
+}
+
+bool convert()
+{
+    const auto saved = simd();
+    bool ok = true;
+    for(auto level : { SIMD_NONE,SIMD_SSE2,SIMD_AVX2,SIMD_NEON })
+    {
+        if(!simdSupported(level))
+            continue;
+        CK_CHECK(setSimd(level) == level);
+        std::cout << "convert: simd " << level << std::endl;
+        ok = convert_level(level) && ok;
+    }
+    setSimd(saved);
+    return ok;
+}
+
+bool dispatch()
+{
+    const auto saved = simd();
+    bool ok = true;
+    for(auto level : { SIMD_NONE,SIMD_SSE2,SIMD_AVX2,SIMD_NEON })
+    {
+        const auto expected = simdSupported(level) ? level : simdDetect();
+        const auto used = setSimd(level);
+        CK_CHECK(used == expected);
+        CK_CHECK(simd() == expected);
+        ok = blend_level(used) && ok;
+    }
+    CK_CHECK(simdSupported(SIMD_NONE));
+    CK_CHECK(simdSupported(simdDetect()));
+    setSimd(saved);
+    return ok;
+}
+
+bool simdEnv()
+{
+    // 第一次调用simd(), 由CKFONT_SIMD决定
+    const auto used = simd();
+    auto expected = simdDetect();
+    if(const char* env = std::getenv("CKFONT_SIMD"))
+    {
+        const char* names[] = { "none","sse2","avx2","neon" };
+        for(int i=0; i<4; ++i)
+        {
+            if(strcmp(env,names[i]) == 0 && simdSupported((Simd)i))
+                expected = (Simd)i;
+        }
+        std::cout << "CKFONT_SIMD=" << env << ", simd " << used << std::endl;
+    }
+    CK_CHECK(used == expected);
+    return blend_level(used);
+}
+
+}
+}
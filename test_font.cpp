@@ -0,0 +1,604 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	test_font.cpp
+@brief 	font behavior test source
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#include "test.h"
+#include "font.h"
+#include "blend.h"
+#include "drawer.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+namespace ck
+{
+namespace test
+{
+
+// 临时文件, 析构时删除
+struct TempFile
+{
+    explicit TempFile(const char* name)
+        : path((std::filesystem::temp_directory_path() / name).string())
+    {}
+    ~TempFile() { std::filesystem::remove(path); }
+    std::string path;
+};
+
+static std::vector<uint8_t> read_file(const std::string& filename)
+{
+    std::ifstream fi(filename,std::ios::binary);
+    return { std::istreambuf_iterator<char>(fi),{} };
+}
+
+// 两个字体的字符信息和像素相同
+static bool same_glyphs(const Font& a,const Font& b)
+{
+    CK_CHECK(a.chrs().size() == b.chrs().size());
+    for(auto& ch : a.chrs())
+    {
+        const auto& other = b.c(ch.code);
+        CK_CHECK(other.code == ch.code);
+        CK_CHECK(other.width == ch.width && other.height == ch.height && other.xadvance == ch.xadvance);
+        CK_CHECK(other.xoffset == ch.xoffset && other.yoffset == ch.yoffset);
+        for(int y=0; y<ch.height; ++y)
+        {
+            for(int x=0; x<ch.width; ++x)
+                CK_CHECK(a.getColor(ch,x,y) == b.getColor(other,x,y));
+        }
+    }
+    return true;
+}
+
+// 24位色字体, 透明色是品红; 'A'的第0列是透明色, 其他像素是不同的颜色
+static constexpr color KEY = 0xff00ff;
+struct KeyedAdapter : Font::Adapter
+{
+    KeyedAdapter()
+    {
+        _header = {};
+        _header.lineHeight = 4;
+        _header.transparent = KEY;
+        Font::Char ch = {};
+        ch.code = 'A';
+        ch.width = 3;
+        ch.height = 2;
+        ch.xadvance = 3;
+        for(int y=0; y<ch.height; ++y)
+        {
+            for(int x=0; x<ch.width; ++x)
+            {
+                if(x == 0)
+                    _data.insert(_data.end(),{ 0xff,0x00,0xff });
+                else
+                    _data.insert(_data.end(),{ uint8_t(x * 60),uint8_t(y * 90),0x20 });
+            }
+        }
+        _chrs.push_back(ch);
+        _header.count = 1;
+    }
+};
+
+// 透明色的像素copyTo后alpha为0, blend时不改变背景; 其他像素不透明
+static bool check_keyed(const Font& fnt)
+{
+    const auto& ch = fnt.c('A');
+    const auto d = fnt.getData(ch);
+    CK_CHECK(d.valid() && d.keyed() && d.key() == KEY);
+    std::vector<color> out(ch.width * ch.height,0x12345678);
+    CK_CHECK(d.copyTo(out.data(),ch.width * sizeof(color),Font::PF_BGRA8));
+    std::vector<color> dst(out.size(),0xff102030);
+    CK_CHECK(blend(dst.data(),ch.width,d));
+    for(int y=0; y<ch.height; ++y)
+    {
+        for(int x=0; x<ch.width; ++x)
+        {
+            const auto i = y * ch.width + x;
+            const auto c = fnt.getColor(ch,x,y);
+            if(x == 0)
+            {
+                CK_CHECK(ca(out[i]) == 0);
+                CK_CHECK(dst[i] == 0xff102030);
+            }
+            else
+            {
+                CK_CHECK(out[i] == (c | 0xff000000));
+                CK_CHECK(dst[i] == (c | 0xff000000));
+            }
+        }
+    }
+    // 经过Data的复制仍然有透明色
+    Font::Data data;
+    CK_CHECK(fnt.getData(ch,data));
+    CK_CHECK(Font::DataPtr(data).keyed() && Font::DataPtr(data).key() == KEY);
+    return true;
+}
+
+bool keyed()
+{
+    Font fnt;
+    CK_CHECK(fnt.load(KeyedAdapter()));
+    CK_CHECK(fnt.header().flag == 0);
+    CK_CHECK(check_keyed(fnt));
+    // 保存时转换为有FL_KEYED的调色板格式
+    TempFile file("ckfont_test_keyed.ckf");
+    CK_CHECK(fnt.save(file.path));
+    Font pal;
+    CK_CHECK(pal.open(file.path));
+    CK_CHECK(pal.header().flag & Font::FL_KEYED);
+    CK_CHECK(pal.header().flag & (Font::FL_PAL4 | Font::FL_PAL8));
+    CK_CHECK(check_keyed(pal));
+    return true;
+}
+
+// 记录每个字符绘制位置的绘制器
+struct RecordDrawer : FontDrawer
+{
+    mutable std::vector<int> xs;
+    void perchar(int x,int,const Font::Char*,const Font::DataPtr&) const override
+    { xs.push_back(x); }
+};
+
+// A8字体, 字符'A'..'Z'和空格, 字符宽度8; wide不为0时再加入宽度为wide, 偏移为-200的字符'a'
+struct LatinAdapter : Font::Adapter
+{
+    explicit LatinAdapter(uint16_t wide = 0)
+    {
+        _header = {};
+        _header.flag = Font::FL_A8;
+        _header.lineHeight = 10;
+        for(char32_t code : U" ABCDEFGHIJKLMNOPQRSTUVWXYZ")
+        {
+            if(code == 0)
+                break;
+            Font::Char ch = {};
+            ch.code = code;
+            ch.width = ch.height = code == ' ' ? 0 : 8;
+            ch.xadvance = 8;
+            ch.pos = (uint32_t)_data.size();
+            for(int i=0; i<ch.width * ch.height; ++i)
+                _data.push_back(uint8_t(code * 7 + i));
+            _chrs.push_back(ch);
+        }
+        if(wide > 0)
+        {
+            Font::Char ch = {};
+            ch.code = 'a';
+            ch.width = ch.xadvance = wide;
+            ch.height = 2;
+            ch.xoffset = -200;
+            ch.pos = (uint32_t)_data.size();
+            for(int i=0; i<ch.width * ch.height; ++i)
+                _data.push_back(uint8_t(i));
+            _chrs.push_back(ch);
+        }
+        _header.count = (uint32_t)_chrs.size();
+    }
+};
+
+bool layout()
+{
+    Font fnt;
+    CK_CHECK(fnt.load(LatinAdapter()));
+    TempFile file("ckfont_test_layout.ckf");
+    const auto n = fnt.chrs().size();
+    for(auto cp : { Font::CP_NONE,Font::CP_BLOCK })
+    {
+        // 数值都在范围内时使用紧凑布局, 每个字符和文件头各少4字节
+        CK_CHECK(fnt.save(file.path,cp,Font::LO_WIDE));
+        const auto wide = read_file(file.path);
+        CK_CHECK(fnt.save(file.path,cp));
+        const auto compact = read_file(file.path);
+        CK_CHECK((wide[3] >> 4) == Font::LO_WIDE);
+        CK_CHECK((compact[3] >> 4) == Font::LO_COMPACT);
+        CK_CHECK(wide.size() - compact.size() == 4 + 4 * n);
+        for(auto md : { Font::MD_COPY,Font::MD_MAP,Font::MD_LAZY })
+        {
+            Font other;
+            CK_CHECK(other.open(file.path,md));
+            CK_CHECK(other.mapped() == (md == Font::MD_MAP));
+            CK_CHECK(same_glyphs(fnt,other));
+        }
+        // 映射紧凑布局时字符表解码到内存, 宽布局直接引用
+        Font mc,mw;
+        CK_CHECK(mc.load(compact.data(),(uint32_t)compact.size(),Font::MD_MAP));
+        CK_CHECK(mw.load(wide.data(),(uint32_t)wide.size(),Font::MD_MAP));
+        CK_CHECK(mc.mapped() && mw.mapped());
+        CK_CHECK(same_glyphs(fnt,mc) && same_glyphs(fnt,mw));
+        CK_CHECK((const uint8_t*)mw.chrs().data() == wide.data() + 4 + sizeof(Font::Header));
+        // 修改映射的字体先复制到内存
+        mc.remove('B');
+        CK_CHECK(!mc.mapped() && mc.chrs().size() == n - 1);
+    }
+
+    // 超出紧凑布局范围的字体使用宽布局
+    Font wide;
+    CK_CHECK(wide.load(LatinAdapter(300)));
+    CK_CHECK(wide.save(file.path));
+    CK_CHECK((read_file(file.path)[3] >> 4) == Font::LO_WIDE);
+    Font other;
+    CK_CHECK(other.open(file.path,Font::MD_MAP));
+    CK_CHECK(other.c('a').width == 300 && other.c('a').xoffset == -200);
+    CK_CHECK(same_glyphs(wide,other));
+    return true;
+}
+
+static std::vector<int> draw_xs(const Font& fnt,const char* text)
+{
+    RecordDrawer d;
+    d.setFont(&fnt);
+    FontDrawer::Options opts;
+    d.draw(fnt.cs(text),0,0,-1,-1,opts);
+    return d.xs;
+}
+
+bool kerning()
+{
+    Font fnt;
+    CK_CHECK(fnt.load(LatinAdapter()));
+    CK_CHECK(!(fnt.header().flag & Font::FL_KERNING));
+    CK_CHECK(fnt.kerning('A','V') == 0);
+    const auto plain = draw_xs(fnt,"AVA TA");
+
+    // 同一字符对保留最后一个; amount为0和超出Unicode的忽略
+    fnt.setKernings({
+        { 'A','V',-2 },
+        { 'V','A',-3 },
+        { 'T','A',0 },
+        { 'A','V',-1 },
+        { 0x110000,'A',5 },
+        { 'T','O',4 },
+    });
+    CK_CHECK(fnt.header().flag & Font::FL_KERNING);
+    CK_CHECK(fnt.kernings().size() == 3);
+    CK_CHECK(fnt.kerning('A','V') == -1);
+    CK_CHECK(fnt.kerning('V','A') == -3);
+    CK_CHECK(fnt.kerning('T','O') == 4);
+    CK_CHECK(fnt.kerning('T','A') == 0);
+    CK_CHECK(fnt.kerning('A','A') == 0);
+    CK_CHECK(fnt.kerning('O','T') == 0);
+    // 绘制时字符对之间移动, 空格前后不调整
+    const auto kerned = draw_xs(fnt,"AVA TA");
+    CK_CHECK(kerned.size() == 5 && plain.size() == 5);
+    CK_CHECK(kerned[0] == plain[0]);
+    CK_CHECK(kerned[1] == plain[1] - 1);
+    CK_CHECK(kerned[2] == plain[2] - 4);
+    CK_CHECK(kerned[3] == plain[3] - 4);
+    CK_CHECK(kerned[4] == plain[4] - 4);
+
+    // 保存/读取后不变
+    TempFile file("ckfont_test_kerning.ckf");
+    for(auto cp : { Font::CP_NONE,Font::CP_LZ4,Font::CP_BLOCK })
+    {
+        CK_CHECK(fnt.save(file.path,cp));
+        for(auto md : { Font::MD_COPY,Font::MD_MAP,Font::MD_LAZY })
+        {
+            Font other;
+            CK_CHECK(other.open(file.path,md));
+            CK_CHECK(other.header().flag & Font::FL_KERNING);
+            CK_CHECK(other.kernings().size() == 3);
+            for(auto& it : fnt.kernings())
+                CK_CHECK(other.kerning(it.first,it.second) == it.amount);
+            CK_CHECK(draw_xs(other,"AVA TA") == kerned);
+        }
+    }
+
+    // 清空后不再保存字距调整表
+    fnt.setKernings({});
+    CK_CHECK(!(fnt.header().flag & Font::FL_KERNING));
+    CK_CHECK(fnt.save(file.path));
+    Font other;
+    CK_CHECK(other.open(file.path));
+    CK_CHECK(other.kernings().empty());
+    CK_CHECK(other.kerning('A','V') == 0);
+    CK_CHECK(draw_xs(other,"AVA TA") == plain);
+    return true;
+}
+
+// 32位色字体, 颜色数超过256(不转换为调色板格式), 每个字符的内容不同
+struct ColorAdapter : Font::Adapter
+{
+    ColorAdapter()
+    {
+        _header = {};
+        _header.flag = Font::FL_BIT32;
+        _header.lineHeight = 8;
+        for(uint32_t i=0; i<20; ++i)
+        {
+            Font::Char ch = {};
+            ch.code = 0x4E00 + i;
+            ch.width = 6;
+            ch.height = 5 + i % 3;
+            ch.xadvance = 7;
+            ch.pos = (uint32_t)_data.size();
+            for(int k=0; k<ch.width * ch.height; ++k)
+                _data.insert(_data.end(),{ uint8_t(k * 9),uint8_t(i * 13),uint8_t(k * 5 + i),uint8_t(k) });
+            _chrs.push_back(ch);
+        }
+        _header.count = (uint32_t)_chrs.size();
+    }
+};
+
+// 读取file的所有方式
+static bool open_all(const Font& fnt,const std::string& file)
+{
+    for(auto md : { Font::MD_COPY,Font::MD_MAP,Font::MD_LAZY })
+    {
+        Font other;
+        CK_CHECK(other.open(file,md));
+        CK_CHECK(same_glyphs(fnt,other));
+    }
+    const auto bytes = read_file(file);
+    for(auto md : { Font::MD_COPY,Font::MD_MAP })
+    {
+        Font other;
+        CK_CHECK(other.load(bytes.data(),(uint32_t)bytes.size(),md));
+        CK_CHECK(same_glyphs(fnt,other));
+    }
+    std::istringstream si(std::string(bytes.begin(),bytes.end()));
+    Font other;
+    CK_CHECK(other.load(si));
+    CK_CHECK(same_glyphs(fnt,other));
+    return true;
+}
+
+bool roundtrip()
+{
+    Font fonts[3];
+    CK_CHECK(fonts[0].load(LatinAdapter()));
+    CK_CHECK(fonts[1].load(ColorAdapter()));
+    CK_CHECK(fonts[2].load(KeyedAdapter()));
+    TempFile file("ckfont_test_roundtrip.ckf");
+    for(auto& fnt : fonts)
+    {
+        for(auto cp : { Font::CP_NONE,Font::CP_BLOCK })
+        {
+            CK_CHECK(fnt.save(file.path,cp));
+            CK_CHECK(open_all(fnt,file.path));
+            // 读取的字体再保存, 内容不变
+            Font other;
+            CK_CHECK(other.open(file.path,Font::MD_MAP));
+            TempFile again("ckfont_test_roundtrip2.ckf");
+            CK_CHECK(other.save(again.path,cp));
+            CK_CHECK(open_all(fnt,again.path));
+        }
+    }
+    return true;
+}
+
+// A8字体, 'A'/'B'/'C'的内容相同, 'D'不同
+struct DupAdapter : Font::Adapter
+{
+    DupAdapter()
+    {
+        _header = {};
+        _header.flag = Font::FL_A8;
+        _header.lineHeight = 8;
+        for(char32_t code : { U'A',U'B',U'C',U'D' })
+        {
+            Font::Char ch = {};
+            ch.code = code;
+            ch.width = ch.height = ch.xadvance = 8;
+            ch.pos = (uint32_t)_data.size();
+            for(int i=0; i<64; ++i)
+                _data.push_back(uint8_t(code == 'D' ? 255 - i : i * 3));
+            _chrs.push_back(ch);
+        }
+        _header.count = (uint32_t)_chrs.size();
+    }
+};
+
+bool dedup()
+{
+    Font src;
+    CK_CHECK(src.load(DupAdapter()));
+    CK_CHECK(src.data().size() == 4 * 64);
+    // 保存时合并内容相同的数据块
+    TempFile file("ckfont_test_dedup.ckf");
+    CK_CHECK(src.save(file.path));
+    Font fnt;
+    CK_CHECK(fnt.open(file.path));
+    CK_CHECK(fnt.data().size() == 2 * 64);
+    CK_CHECK(fnt.c('A').pos == fnt.c('B').pos && fnt.c('B').pos == fnt.c('C').pos);
+    CK_CHECK(fnt.c('D').pos != fnt.c('A').pos);
+    CK_CHECK(same_glyphs(src,fnt));
+
+    // 替换共用数据块的字符不影响其他字符
+    const Font::Data d(src.getData(src.c('D')));
+    Font::Char ch = src.c('B');
+    CK_CHECK(fnt.insert(ch,d));
+    CK_CHECK(fnt.getColor(fnt.c('B'),0,0) == src.getColor(src.c('D'),0,0));
+    CK_CHECK(fnt.getColor(fnt.c('C'),1,0) == src.getColor(src.c('C'),1,0));
+
+    // 删除共用数据块的字符, 还有其他字符使用时不作废
+    fnt.beginEdit();
+    fnt.remove('A');
+    fnt.compact();
+    const auto size = fnt.data().size();
+    CK_CHECK(size >= 2 * 64);
+    for(int i=0; i<64; ++i)
+        CK_CHECK(fnt.getColor(fnt.c('C'),i % 8,i / 8) == src.getColor(src.c('C'),i % 8,i / 8));
+    // 最后一个字符删除后回收
+    fnt.remove('C');
+    fnt.compact();
+    CK_CHECK(fnt.data().size() == size - 64);
+    fnt.endEdit();
+    CK_CHECK(fnt.chrs().size() == 2);
+    for(int i=0; i<64; ++i)
+    {
+        CK_CHECK(fnt.getColor(fnt.c('D'),i % 8,i / 8) == src.getColor(src.c('D'),i % 8,i / 8));
+        CK_CHECK(fnt.getColor(fnt.c('B'),i % 8,i / 8) == src.getColor(src.c('D'),i % 8,i / 8));
+    }
+    // 再次保存, 'B'与'D'合并
+    CK_CHECK(fnt.save(file.path));
+    Font other;
+    CK_CHECK(other.open(file.path));
+    CK_CHECK(other.data().size() == 64);
+    CK_CHECK(same_glyphs(fnt,other));
+    return true;
+}
+
+// 把字符的alpha画到画布上
+struct CanvasDrawer : FontDrawer
+{
+    static constexpr int W = 256, H = 32;
+    mutable std::vector<uint8_t> canvas = std::vector<uint8_t>(W * H,0);
+    void perchar(int x,int y,const Font::Char*,const Font::DataPtr& d) const override
+    {
+        for(int j=0; j<d.h(); ++j)
+        {
+            for(int i=0; i<d.w(); ++i)
+            {
+                const auto a = ca(d.get(i,j));
+                if(a != 0 && x + i >= 0 && x + i < W && y + j >= 0 && y + j < H)
+                    canvas[(y + j) * W + x + i] = a;
+            }
+        }
+    }
+};
+
+// A8字体, 每个字符10x12, 四周有不同宽度的透明像素
+struct PaddedAdapter : Font::Adapter
+{
+    PaddedAdapter()
+    {
+        _header = {};
+        _header.flag = Font::FL_A8;
+        _header.lineHeight = 14;
+        for(int i=0; i<26; ++i)
+        {
+            Font::Char ch = {};
+            ch.code = 'A' + i;
+            ch.width = 10;
+            ch.height = 12;
+            ch.xadvance = 11;
+            ch.xoffset = i % 3 - 1;
+            ch.yoffset = 1;
+            ch.pos = (uint32_t)_data.size();
+            const int l = i % 4, t = i % 5, r = 10 - i % 3, b = 12 - i % 2;
+            for(int y=0; y<ch.height; ++y)
+            {
+                for(int x=0; x<ch.width; ++x)
+                    _data.push_back(x >= l && x < r && y >= t && y < b ? uint8_t(40 + x * 10 + y) : 0);
+            }
+            _chrs.push_back(ch);
+        }
+        _header.count = (uint32_t)_chrs.size();
+    }
+};
+
+static bool render(const Font& fnt,const char* text,FontDrawer::Box& box,std::vector<uint8_t>& canvas)
+{
+    CanvasDrawer d;
+    d.setFont(&fnt);
+    FontDrawer::Options opts;
+    const auto chrs = fnt.cs(text);
+    box = d.measure(chrs,120,-1,opts);
+    d.draw(chrs,4,2,120,-1,opts);
+    canvas = d.canvas;
+    return true;
+}
+
+bool trim()
+{
+    Font fnt;
+    CK_CHECK(fnt.load(PaddedAdapter()));
+    const char* text = "ABCD EFGHIJ KLMNOP QRS";
+    FontDrawer::Box before,after;
+    std::vector<uint8_t> canvas_before,canvas_after;
+    render(fnt,text,before,canvas_before);
+
+    const auto size = fnt.data().size();
+    const auto saved = fnt.trim();
+    CK_CHECK(saved > 0);
+    CK_CHECK(fnt.data().size() == size - saved);
+    CK_CHECK(fnt.c('B').width < 10 && fnt.c('B').xadvance == 11);
+    // 排版和绘制的结果不变
+    render(fnt,text,after,canvas_after);
+    CK_CHECK(after.x == before.x && after.y == before.y && after.w == before.w && after.h == before.h);
+    CK_CHECK(canvas_after == canvas_before);
+    // 再裁剪没有变化
+    CK_CHECK(fnt.trim() == 0);
+    return true;
+}
+
+// 把CP_BLOCK文件的块索引替换为index, 返回新的文件内容
+static std::vector<uint8_t> replace_index(std::vector<uint8_t> bytes,size_t at,const std::vector<uint32_t>& index)
+{
+    uint32_t count;
+    memcpy(&count,bytes.data() + at,4);
+    bytes.erase(bytes.begin() + at,bytes.begin() + at + 4 + count * 8);
+    std::vector<uint8_t> raw(index.size() * 4);
+    memcpy(raw.data(),index.data(),raw.size());
+    bytes.insert(bytes.begin() + at,raw.begin(),raw.end());
+    return bytes;
+}
+
+// 所有读取方式都失败
+static bool reject_all(const std::vector<uint8_t>& bytes,const std::string& file)
+{
+    {
+        std::ofstream fo(file,std::ios::binary);
+        fo.write((const char*)bytes.data(),bytes.size());
+    }
+    for(auto md : { Font::MD_COPY,Font::MD_MAP,Font::MD_LAZY })
+    {
+        Font fnt;
+        CK_CHECK(!fnt.open(file,md));
+    }
+    for(auto md : { Font::MD_COPY,Font::MD_MAP })
+    {
+        Font fnt;
+        CK_CHECK(!fnt.load(bytes.data(),(uint32_t)bytes.size(),md));
+    }
+    std::istringstream si(std::string(bytes.begin(),bytes.end()));
+    Font fnt;
+    CK_CHECK(!fnt.load(si));
+    return true;
+}
+
+bool blocks()
+{
+    Font fnt;
+    CK_CHECK(fnt.load(LatinAdapter()));
+    TempFile file("ckfont_test_blocks.ckf");
+    CK_CHECK(fnt.save(file.path,Font::CP_BLOCK,Font::LO_WIDE));
+    const auto good = read_file(file.path);
+    // 宽布局, A8没有调色板, 没有字距调整表: 块索引紧接字符表
+    const size_t at = 4 + sizeof(Font::Header) + fnt.chrs().size() * sizeof(Font::Char);
+    uint32_t count,size,packed;
+    memcpy(&count,good.data() + at,4);
+    memcpy(&size,good.data() + at + 4,4);
+    memcpy(&packed,good.data() + at + 8,4);
+    CK_CHECK(count == 1 && size == fnt.data().size());
+    CK_CHECK(replace_index(good,at,{ 1,size,packed }) == good);
+
+    // 在块索引中截断
+    CK_CHECK(reject_all(std::vector<uint8_t>(good.begin(),good.begin() + at + 6),file.path));
+    // 在压缩数据中截断
+    CK_CHECK(reject_all(std::vector<uint8_t>(good.begin(),good.end() - 1),file.path));
+    // 块数远超文件大小
+    CK_CHECK(reject_all(replace_index(good,at,{ 0xFFFFFFFF }),file.path));
+    // 块的大小相加超出32位后回绕, 总和与字符表相符
+    CK_CHECK(reject_all(replace_index(good,at,{ 2,0xFFFFFFF0,packed,size + 0x10,0 }),file.path));
+    // 解压后的大小与压缩的大小不相称
+    CK_CHECK(reject_all(replace_index(good,at,{ 1,0x7FFFFFFF,packed }),file.path));
+    CK_CHECK(reject_all(replace_index(good,at,{ 1,size,0x7FFFFFFF }),file.path));
+    return true;
+}
+
+}
+}
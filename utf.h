@@ -0,0 +1,183 @@
+/*
+*******************************************************************************
+    ChenKe404's font library
+*******************************************************************************
+@project	ckfont
+@authors	chenke404
+@file	utf.h
+@brief 	UTF-8/UTF-16 decoder header
+
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2025 chenke404
+******************************************************************************
+*/
+
+#ifndef CK_UTF_H
+#define CK_UTF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CK_UTF_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CK_UTF_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace ck
+{
+namespace utf
+{
+
+// 非法编码的替换字符
+static constexpr char32_t REPLACEMENT = 0xFFFD;
+
+// 解码UTF-8, 每个码点调用一次fn(char32_t); 非法或截断的序列输出REPLACEMENT
+// 连续的ASCII字符每次检查16字节(SIMD)或8字节
+template<typename Fn>
+inline void decode(const char* str, size_t len, Fn&& fn)
+{
+    auto p = (const uint8_t*)str;
+    const auto end = p + len;
+    while(p < end)
+    {
+        // ASCII快速路径
+#if defined(CK_UTF_SSE2)
+        while(end - p >= 16)
+        {
+            const auto v = _mm_loadu_si128((const __m128i*)p);
+            if(_mm_movemask_epi8(v) != 0)
+                break;
+            for(int i=0; i<16; ++i)
+                fn(char32_t(p[i]));
+            p += 16;
+        }
+#elif defined(CK_UTF_NEON)
+        while(end - p >= 16)
+        {
+            if(vmaxvq_u8(vld1q_u8(p)) >= 0x80)
+                break;
+            for(int i=0; i<16; ++i)
+                fn(char32_t(p[i]));
+            p += 16;
+        }
+#endif
+        while(end - p >= 8)
+        {
+            uint64_t w;
+            memcpy(&w,p,8);
+            if(w & 0x8080808080808080ull)
+                break;
+            for(int i=0; i<8; ++i)
+                fn(char32_t(p[i]));
+            p += 8;
+        }
+        if(p >= end)
+            break;
+
+        const uint8_t c = *p;
+        if(c < 0x80)
+        {
+            fn(char32_t(c));
+            ++p;
+            continue;
+        }
+
+        int n;          // 后续字节数
+        char32_t cp;
+        char32_t min;   // 防止过长编码
+        if(c >= 0xC2 && c <= 0xDF)      { n = 1; cp = c & 0x1F; min = 0x80; }
+        else if((c & 0xF0) == 0xE0)     { n = 2; cp = c & 0x0F; min = 0x800; }
+        else if(c >= 0xF0 && c <= 0xF4) { n = 3; cp = c & 0x07; min = 0x10000; }
+        else
+        {
+            fn(REPLACEMENT);
+            ++p;
+            continue;
+        }
+
+        int i = 1;
+        for(; i<=n && p+i<end && (p[i] & 0xC0) == 0x80; ++i)
+        {
+            cp = (cp << 6) | (p[i] & 0x3F);
+        }
+        if(i <= n || cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            fn(REPLACEMENT);
+        else
+            fn(cp);
+        p += i;
+    }
+}
+
+// 解码UTF-16, 每个码点调用一次fn(char32_t); 不成对的代理项输出REPLACEMENT
+template<typename C, typename Fn>
+inline void decode16(const C* str, size_t len, Fn&& fn)
+{
+    static_assert(sizeof(C) == 2,"UTF-16 code unit must be 2 bytes");
+    size_t i = 0;
+    while(i < len)
+    {
+        // 不含代理项的快速路径
+#if defined(CK_UTF_SSE2)
+        while(len - i >= 8)
+        {
+            const auto v = _mm_loadu_si128((const __m128i*)(str + i));
+            const auto s = _mm_cmpeq_epi16(
+                _mm_and_si128(v,_mm_set1_epi16((short)0xF800)),
+                _mm_set1_epi16((short)0xD800));
+            if(_mm_movemask_epi8(s) != 0)
+                break;
+            for(int k=0; k<8; ++k)
+                fn(char32_t(uint16_t(str[i+k])));
+            i += 8;
+        }
+        if(i >= len)
+            break;
+#endif
+        const char32_t u = uint16_t(str[i]);
+        if(u < 0xD800 || u > 0xDFFF)
+        {
+            fn(u);
+            ++i;
+        }
+        else if(u < 0xDC00 && i + 1 < len &&
+                 uint16_t(str[i+1]) >= 0xDC00 && uint16_t(str[i+1]) <= 0xDFFF)
+        {
+            fn(0x10000 + ((u - 0xD800) << 10) + (uint16_t(str[i+1]) - 0xDC00));
+            i += 2;
+        }
+        else
+        {
+            fn(REPLACEMENT);
+            ++i;
+        }
+    }
+}
+
+// 宽字符: 2字节时按UTF-16解码(Windows), 否则按UTF-32
+template<typename Fn>
+inline void decode(const wchar_t* str, size_t len, Fn&& fn)
+{
+    if constexpr (sizeof(wchar_t) == 2)
+        decode16(str,len,fn);
+    else
+    {
+        for(size_t i=0; i<len; ++i)
+            fn(char32_t(str[i]));
+    }
+}
+
+template<typename Fn>
+inline void decode(const char32_t* str, size_t len, Fn&& fn)
+{
+    for(size_t i=0; i<len; ++i)
+        fn(str[i]);
+}
+
+}
+}
+
+#endif // CK_UTF_H